@@ -1,22 +1,228 @@
 // WAP to implement matrix addition and multiplication
 // then do matrix addition and multiplication on two random matrices
 // and plot the mean of the resultant matrices
+//
+// Build: gcc -O3 lab-1.c -o lab-1 -lpthread -lm
+// Bench: ./lab-1 bench [--csv | --json] [--out FILE] [--sizes 64,256,...]
+// Files: ./lab-1 save ROWS COLS FILE, ./lab-1 load FILE
+// Dtypes: ./lab-1 dtypes [n ...]
+// Sparse: ./lab-1 sparse DENSITY [n ...]
 
+#define _FILE_OFFSET_BITS 64 // 64-bit off_t for fseeko on 32-bit systems
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #define MATRIX_TYPE float
+#define MATRIX_ALIGN 64
 
+// Who owns data: OWNED buffers come from newMatrix and MAPPED ones from
+// loadMatrixMapped, and both are released by deleteMatrix; VIEW, ARENA and
+// MAPPED_VIEW matrices borrow memory owned elsewhere. MAPPED memory is
+// read-only.
+typedef enum MatrixStorage
+{
+  MATRIX_STORAGE_VIEW,
+  MATRIX_STORAGE_OWNED,
+  MATRIX_STORAGE_ARENA,
+  MATRIX_STORAGE_MAPPED,
+  MATRIX_STORAGE_MAPPED_VIEW // a view into a mapped file, read-only like it
+} MatrixStorage;
+
+// Element types. Reduced-precision matrices are storage formats: GEMM widens
+// bf16/fp16 to float while packing and accumulates in float, and two int8
+// matrices multiply with int32 accumulation. MATRIX_I8 is symmetric
+// quantization, value = q * scale. Everything else works on MATRIX_F32.
+typedef enum MatrixDtype
+{
+  MATRIX_F32,
+  MATRIX_BF16,
+  MATRIX_F16,
+  MATRIX_I8
+} MatrixDtype;
+
+// Element (i, j) lives at data[i * rowStride + j * colStride]. Matrices made
+// by newMatrix are contiguous row-major (rowStride = cols, colStride = 1) on a
+// MATRIX_ALIGN boundary; views keep the parent's strides, and a transposed
+// view just swaps them, so one of the two strides is always 1. Strides count
+// elements of the matrix's own dtype.
 typedef struct Matrix_t
 {
   int rows;
   int cols;
-  MATRIX_TYPE *data;
+  union
+  {
+    MATRIX_TYPE *data; // MATRIX_F32
+    uint16_t *half;    // MATRIX_BF16, MATRIX_F16
+    int8_t *q8;        // MATRIX_I8
+  };
+  int rowStride;
+  int colStride;
+  MatrixStorage storage;
+  MatrixDtype dtype;
+  float scale; // MATRIX_I8
 } Matrix_t;
 
+#define MATRIX_AT(m, i, j) ((m)->data[(size_t)(i) * (m)->rowStride + (size_t)(j) * (m)->colStride])
+
+static const char *const matrixDtypeNames[] = {"f32", "bf16", "f16", "i8"};
+
+static size_t matrixDtypeSize(MatrixDtype dtype)
+{
+  static const size_t sizes[] = {sizeof(MATRIX_TYPE), 2, 2, 1};
+  return sizes[dtype];
+}
+
+// Address of element (i, j) for any dtype
+static void *matrixAddress(const Matrix_t *m, size_t i, size_t j)
+{
+  return (unsigned char *)m->data + (i * m->rowStride + j * m->colStride) * matrixDtypeSize(m->dtype);
+}
+
+// Also rejects NULL matrices and failed views (data == NULL)
+static int matrixRequireF32(const Matrix_t *m, const char *op)
+{
+  if (!m || !m->data)
+  {
+    fprintf(stderr, "Error: %s got an invalid matrix.\n", op);
+    return -1;
+  }
+  if (m->dtype == MATRIX_F32)
+    return 0;
+  fprintf(stderr, "Error: %s needs f32 matrices, got %s; convert it first.\n", op, matrixDtypeNames[m->dtype]);
+  return -1;
+}
+
+// Files are mapped read-only, so a mapped matrix (or a view of one) can
+// only be read; the first store would fault
+static int matrixRequireWritable(const Matrix_t *m, const char *op)
+{
+  if (m->storage != MATRIX_STORAGE_MAPPED && m->storage != MATRIX_STORAGE_MAPPED_VIEW)
+    return 0;
+  fprintf(stderr, "Error: %s cannot write to a read-only mapped matrix.\n", op);
+  return -1;
+}
+
+// Views of mapped matrices stay read-only
+static MatrixStorage matrixViewStorage(const Matrix_t *parent)
+{
+  return parent->storage == MATRIX_STORAGE_MAPPED || parent->storage == MATRIX_STORAGE_MAPPED_VIEW
+             ? MATRIX_STORAGE_MAPPED_VIEW
+             : MATRIX_STORAGE_VIEW;
+}
+
+static float bf16ToFloat(uint16_t h)
+{
+  uint32_t bits = (uint32_t)h << 16;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Round to nearest even; NaNs stay NaN
+static uint16_t floatToBf16(float f)
+{
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  if ((bits & 0x7FFFFFFF) > 0x7F800000)
+    return (uint16_t)(bits >> 16 | 0x40);
+  return (uint16_t)((bits + 0x7FFF + (bits >> 16 & 1)) >> 16);
+}
+
+static float f16ToFloat(uint16_t h)
+{
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = h >> 10 & 0x1F, mantissa = h & 0x3FF, bits;
+  if (exponent == 0x1F)
+    bits = sign | 0x7F800000 | mantissa << 13;
+  else if (exponent)
+    bits = sign | (exponent + 112) << 23 | mantissa << 13;
+  else
+  {
+    float f = (float)mantissa * (1.0f / 16777216.0f); // subnormal: mantissa * 2^-24
+    return sign ? -f : f;
+  }
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Round to nearest even, overflow to infinity
+static uint16_t floatToF16(float f)
+{
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  uint32_t sign = bits >> 16 & 0x8000, magnitude = bits & 0x7FFFFFFF;
+  if (magnitude > 0x7F800000)
+    return (uint16_t)(sign | 0x7E00);
+  if (magnitude >= 0x477FF000) // 65520 and up round past the largest half
+    return (uint16_t)(sign | 0x7C00);
+  if (magnitude < 0x38800000) // below 2^-14: let the FPU round to a multiple of 2^-24
+  {
+    float a, r;
+    memcpy(&a, &magnitude, sizeof(a));
+    r = a + 0.5f;
+    uint32_t rounded;
+    memcpy(&rounded, &r, sizeof(rounded));
+    return (uint16_t)(sign | (rounded - 0x3F000000));
+  }
+  magnitude += 0xC8000FFF + (magnitude >> 13 & 1); // rebias exponent by -112, round
+  return (uint16_t)(sign | magnitude >> 13);
+}
+
+// Element idx of a buffer of the given dtype, widened to float
+static inline float matrixLoad(const void *data, size_t idx, MatrixDtype dtype, float scale)
+{
+  switch (dtype)
+  {
+  case MATRIX_BF16:
+    return bf16ToFloat(((const uint16_t *)data)[idx]);
+  case MATRIX_F16:
+    return f16ToFloat(((const uint16_t *)data)[idx]);
+  case MATRIX_I8:
+    return ((const int8_t *)data)[idx] * scale;
+  default:
+    return ((const MATRIX_TYPE *)data)[idx];
+  }
+}
+
+static void *alignedAlloc(size_t size)
+{
+  size = (size + MATRIX_ALIGN - 1) & ~(size_t)(MATRIX_ALIGN - 1);
+#ifdef _WIN32
+  return _aligned_malloc(size ? size : MATRIX_ALIGN, MATRIX_ALIGN);
+#else
+  void *p = NULL;
+  return posix_memalign(&p, MATRIX_ALIGN, size ? size : MATRIX_ALIGN) == 0 ? p : NULL;
+#endif
+}
+
+static void alignedFree(void *p)
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
 // Object management functions
-Matrix_t *newMatrix(int rows, int cols)
+Matrix_t *newMatrixOfType(int rows, int cols, MatrixDtype dtype)
 {
   Matrix_t *matrix = (Matrix_t *)malloc(sizeof(*matrix));
   if (!matrix)
@@ -27,7 +233,12 @@ Matrix_t *newMatrix(int rows, int cols)
 
   matrix->rows = rows;
   matrix->cols = cols;
-  matrix->data = (MATRIX_TYPE *)malloc(sizeof(MATRIX_TYPE) * rows * cols);
+  matrix->rowStride = cols;
+  matrix->colStride = 1;
+  matrix->storage = MATRIX_STORAGE_OWNED;
+  matrix->dtype = dtype;
+  matrix->scale = 1.0f;
+  matrix->data = (MATRIX_TYPE *)alignedAlloc(matrixDtypeSize(dtype) * rows * cols);
   if (!matrix->data)
   {
     free(matrix);
@@ -36,98 +247,3840 @@ Matrix_t *newMatrix(int rows, int cols)
   return matrix;
 }
 
+Matrix_t *newMatrix(int rows, int cols)
+{
+  return newMatrixOfType(rows, cols, MATRIX_F32);
+}
+
+// Kept out of line: it reaches past the Matrix_t into the MappedMatrix
+// around it, which the compiler cannot see from here
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+static void unmapMatrixFile(Matrix_t *matrix);
+
 void deleteMatrix(Matrix_t *matrix)
 {
-  if (matrix)
+  if (!matrix)
+    return;
+  if (matrix->storage == MATRIX_STORAGE_MAPPED)
   {
-    free(matrix->data);
-    free(matrix);
+    unmapMatrixFile(matrix);
+    return;
+  }
+  if (matrix->storage != MATRIX_STORAGE_OWNED)
+  {
+    fprintf(stderr, "Error: deleteMatrix() called on a view or arena matrix.\n");
+    return;
   }
+  alignedFree(matrix->data);
+  free(matrix);
 }
 
-// Matrix operations
-Matrix_t *addMatrices(const Matrix_t *A, const Matrix_t *B)
+// Views
+// A view is a Matrix_t by value pointing into its parent's buffer: no copy,
+// no allocation, and it stays valid only as long as the parent does. Any
+// lab-1 operation accepts a view wherever it accepts a matrix. On bad
+// bounds the returned view has data == NULL, which every operation rejects.
+Matrix_t matrixView(const Matrix_t *parent, int row0, int col0, int rows, int cols)
 {
-  if (A->rows != B->rows || A->cols != B->cols)
+  Matrix_t view = {rows, cols, {NULL}, 0, 1, MATRIX_STORAGE_VIEW, MATRIX_F32, 1.0f};
+  if (!parent || !parent->data || row0 < 0 || col0 < 0 || rows < 0 || cols < 0 ||
+      row0 + rows > parent->rows || col0 + cols > parent->cols)
   {
-    fprintf(stderr, "Error: Matrices must have the same dimensions for addition.\n");
-    return NULL;
+    fprintf(stderr, "Error: View [%d:+%d, %d:+%d] is out of bounds.\n", row0, rows, col0, cols);
+    return view;
   }
 
-  Matrix_t *result = newMatrix(A->rows, A->cols);
-  if (!result)
+  view.data = (MATRIX_TYPE *)matrixAddress(parent, (size_t)row0, (size_t)col0);
+  view.storage = matrixViewStorage(parent);
+  view.rowStride = parent->rowStride;
+  view.colStride = parent->colStride;
+  view.dtype = parent->dtype;
+  view.scale = parent->scale;
+  return view;
+}
+
+Matrix_t matrixRowBlock(const Matrix_t *parent, int row0, int rows)
+{
+  return matrixView(parent, row0, 0, rows, parent ? parent->cols : 0);
+}
+
+Matrix_t matrixColBlock(const Matrix_t *parent, int col0, int cols)
+{
+  return matrixView(parent, 0, col0, parent ? parent->rows : 0, cols);
+}
+
+Matrix_t matrixTransposeView(const Matrix_t *parent)
+{
+  if (!parent)
   {
-    return NULL;
+    Matrix_t invalid = {0, 0, {NULL}, 0, 1, MATRIX_STORAGE_VIEW, MATRIX_F32, 1.0f};
+    return invalid;
+  }
+  Matrix_t view = {parent->cols, parent->rows, {parent->data}, parent->colStride, parent->rowStride,
+                   matrixViewStorage(parent), parent->dtype, parent->scale};
+  return view;
+}
+
+// Rows are adjacent and unit-stride, i.e. the elements are data[0, rows * cols)
+int matrixIsContiguous(const Matrix_t *matrix)
+{
+  return (matrix->colStride == 1 || matrix->cols <= 1) &&
+         (matrix->rowStride == matrix->cols || matrix->rows <= 1);
+}
+
+// Wrap a row-major buffer with leading dimension ld as a view
+static Matrix_t matrixWrap(MATRIX_TYPE *data, int rows, int cols, int ld)
+{
+  Matrix_t view = {rows, cols, {data}, ld, 1, MATRIX_STORAGE_VIEW, MATRIX_F32, 1.0f};
+  return view;
+}
+
+// Whether a and b may share an element. Address ranges decide most cases;
+// blocks of one row-major parent are compared as rectangles.
+static int matrixOverlaps(const Matrix_t *a, const Matrix_t *b)
+{
+  if (a->rows == 0 || a->cols == 0 || b->rows == 0 || b->cols == 0)
+    return 0;
+  const unsigned char *aBegin = (const unsigned char *)a->data, *bBegin = (const unsigned char *)b->data;
+  const unsigned char *aEnd = (const unsigned char *)matrixAddress(a, a->rows - 1, a->cols - 1) + matrixDtypeSize(a->dtype);
+  const unsigned char *bEnd = (const unsigned char *)matrixAddress(b, b->rows - 1, b->cols - 1) + matrixDtypeSize(b->dtype);
+  if (aEnd <= bBegin || bEnd <= aBegin)
+    return 0;
+
+  if (a->colStride != 1 || b->colStride != 1 || a->rowStride != b->rowStride || a->rowStride <= 0 ||
+      a->dtype != b->dtype || (bBegin - aBegin) % (ptrdiff_t)matrixDtypeSize(a->dtype))
+    return 1;
+
+  // b starts at (dr, dc) relative to a, with dc in (-ld, ld): two candidates
+  ptrdiff_t ld = a->rowStride, d = (bBegin - aBegin) / (ptrdiff_t)matrixDtypeSize(a->dtype);
+  ptrdiff_t dr = d >= 0 ? d / ld : -((-d + ld - 1) / ld), dc = d - dr * ld;
+  for (int candidate = 0; candidate < 2; candidate++, dr++, dc -= ld)
+    if (dr < a->rows && dr + b->rows > 0 && dc < a->cols && dc + b->cols > 0)
+      return 1;
+  return 0;
+}
+
+// dst = src element by element; either may be a view of any layout, but
+// they must not partially overlap
+int copyMatrixInto(const Matrix_t *src, Matrix_t *dst)
+{
+  if (!src || !dst || !src->data || !dst->data || src->rows != dst->rows || src->cols != dst->cols ||
+      src->dtype != dst->dtype)
+  {
+    fprintf(stderr, "Error: Copy needs two valid matrices of the same dimensions and dtype.\n");
+    return -1;
+  }
+  if (matrixRequireWritable(dst, "Copy"))
+    return -1;
+
+  Matrix_t s = *src, d = *dst;
+  if (s.colStride != 1 && d.colStride != 1)
+  {
+    s = matrixTransposeView(src);
+    d = matrixTransposeView(dst);
+  }
+
+  size_t size = matrixDtypeSize(s.dtype);
+  for (int i = 0; i < s.rows; i++)
+  {
+    if (s.colStride == 1 && d.colStride == 1)
+      memmove(matrixAddress(&d, i, 0), matrixAddress(&s, i, 0), size * s.cols);
+    else
+      for (int j = 0; j < s.cols; j++)
+        memcpy(matrixAddress(&d, i, j), matrixAddress(&s, i, j), size);
+  }
+  dst->scale = src->scale;
+  return 0;
+}
+
+// Dtype conversion
+// dst = src converted element by element through float. An int8 destination
+// gets a symmetric per-matrix scale, max |src| / 127, so the largest element
+// maps to +-127.
+static inline void matrixStore(void *data, size_t idx, MatrixDtype dtype, float scale, float value)
+{
+  switch (dtype)
+  {
+  case MATRIX_BF16:
+    ((uint16_t *)data)[idx] = floatToBf16(value);
+    break;
+  case MATRIX_F16:
+    ((uint16_t *)data)[idx] = floatToF16(value);
+    break;
+  case MATRIX_I8:
+  {
+    float q = value / scale;
+    q = q > 127.0f ? 127.0f : q < -127.0f ? -127.0f : q;
+    ((int8_t *)data)[idx] = (int8_t)(q >= 0 ? q + 0.5f : q - 0.5f);
+    break;
+  }
+  default:
+    ((MATRIX_TYPE *)data)[idx] = value;
   }
+}
+
+int convertMatrixInto(const Matrix_t *src, Matrix_t *dst)
+{
+  if (!src || !dst || !src->data || !dst->data || src->rows != dst->rows || src->cols != dst->cols)
+  {
+    fprintf(stderr, "Error: Conversion needs two valid matrices of the same dimensions.\n");
+    return -1;
+  }
+  if (matrixRequireWritable(dst, "Conversion"))
+    return -1;
 
-  for (int i = 0; i < A->rows; i++)
+  if (dst->dtype == MATRIX_I8)
   {
-    for (int j = 0; j < A->cols; j++)
+    float maxAbs = 0.0f;
+    for (int i = 0; i < src->rows; i++)
+      for (int j = 0; j < src->cols; j++)
+      {
+        float v = matrixLoad(src->data, (size_t)i * src->rowStride + (size_t)j * src->colStride, src->dtype, src->scale);
+        v = v < 0 ? -v : v;
+        maxAbs = v > maxAbs ? v : maxAbs;
+      }
+    dst->scale = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+  }
+
+  for (int i = 0; i < src->rows; i++)
+    for (int j = 0; j < src->cols; j++)
     {
-      result->data[i * A->cols + j] = A->data[i * A->cols + j] + B->data[i * B->cols + j];
+      float v = matrixLoad(src->data, (size_t)i * src->rowStride + (size_t)j * src->colStride, src->dtype, src->scale);
+      matrixStore(dst->data, (size_t)i * dst->rowStride + (size_t)j * dst->colStride, dst->dtype, dst->scale, v);
     }
+  return 0;
+}
+
+Matrix_t *convertMatrix(const Matrix_t *src, MatrixDtype dtype)
+{
+  if (!src || !src->data)
+  {
+    fprintf(stderr, "Error: Invalid matrix pointer.\n");
+    return NULL;
   }
-  return result;
+
+  Matrix_t *dst = newMatrixOfType(src->rows, src->cols, dtype);
+  if (dst && convertMatrixInto(src, dst) != 0)
+  {
+    deleteMatrix(dst);
+    return NULL;
+  }
+  return dst;
 }
 
-Matrix_t *multiplyMatrices(const Matrix_t *A, const Matrix_t *B)
+// Symmetric int8 quantization and its inverse
+Matrix_t *quantizeMatrix(const Matrix_t *src)
 {
-  if (A->cols != B->rows)
+  return convertMatrix(src, MATRIX_I8);
+}
+
+Matrix_t *dequantizeMatrix(const Matrix_t *src)
+{
+  return convertMatrix(src, MATRIX_F32);
+}
+
+// Matrix arena
+// A bump allocator over one fixed block: matrices taken from it cost a
+// pointer increment and are all released at once by resetMatrixArena().
+// Never pass an arena matrix to deleteMatrix().
+#define ARENA_ALIGN 64
+
+typedef struct MatrixArena
+{
+  unsigned char *base;
+  size_t capacity;
+  size_t used;
+} MatrixArena;
+
+MatrixArena *newMatrixArena(size_t capacity)
+{
+  MatrixArena *arena = (MatrixArena *)malloc(sizeof(*arena));
+  if (!arena)
   {
-    fprintf(stderr, "Error: Number of columns in A must equal number of rows in B for multiplication.\n");
+    fprintf(stderr, "Error: Memory allocation failed for matrix arena.\n");
     return NULL;
   }
 
-  Matrix_t *result = newMatrix(A->rows, B->cols);
-  if (!result)
+  // Over-allocate so the first block can be aligned
+  arena->base = (unsigned char *)malloc(capacity + ARENA_ALIGN);
+  if (!arena->base)
+  {
+    fprintf(stderr, "Error: Memory allocation failed for %zu byte arena.\n", capacity);
+    free(arena);
+    return NULL;
+  }
+  arena->capacity = capacity + ARENA_ALIGN;
+  arena->used = 0;
+  return arena;
+}
+
+void deleteMatrixArena(MatrixArena *arena)
+{
+  if (arena)
+  {
+    free(arena->base);
+    free(arena);
+  }
+}
+
+void *arenaAlloc(MatrixArena *arena, size_t size)
+{
+  // Align the address, not the offset: base itself need not be aligned
+  size_t pad = (size_t)(-(uintptr_t)(arena->base + arena->used) & (ARENA_ALIGN - 1));
+  size_t offset = arena->used + pad;
+  if (offset > arena->capacity || size > arena->capacity - offset)
   {
+    fprintf(stderr, "Error: Matrix arena exhausted (%zu of %zu bytes used).\n", arena->used, arena->capacity);
+    return NULL;
+  }
+  arena->used = offset + size;
+  return arena->base + offset;
+}
+
+Matrix_t *newArenaMatrix(MatrixArena *arena, int rows, int cols)
+{
+  Matrix_t *matrix = (Matrix_t *)arenaAlloc(arena, sizeof(*matrix));
+  if (!matrix)
     return NULL;
+
+  matrix->rows = rows;
+  matrix->cols = cols;
+  matrix->rowStride = cols;
+  matrix->colStride = 1;
+  matrix->storage = MATRIX_STORAGE_ARENA;
+  matrix->dtype = MATRIX_F32;
+  matrix->scale = 1.0f;
+  matrix->data = (MATRIX_TYPE *)arenaAlloc(arena, sizeof(MATRIX_TYPE) * rows * cols);
+  return matrix->data ? matrix : NULL;
+}
+
+// Releases every matrix taken from the arena
+void resetMatrixArena(MatrixArena *arena)
+{
+  arena->used = 0;
+}
+
+// Kernel layer
+// Hot loops go through a table of function pointers chosen once from the CPU
+// features (SSE2 / AVX2+FMA / AVX-512F+BW) with the portable C versions as the
+// fallback. In reproducible mode every ISA sums in the same canonical order
+// (8 interleaved double lanes, fixed combine tree) so sums and means are
+// bit-identical across machines; fast mode uses as many accumulators as the
+// ISA likes.
+#define GEMM_MR 6
+#define GEMM_NR 16
+#define GEMM_I8_MR 8 // int8 GEMM rows per micro-tile; divides GEMM_MC
+#define SUM_LANES 8
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+_Static_assert(sizeof(MATRIX_TYPE) == sizeof(float), "SIMD kernels assume MATRIX_TYPE is float");
+
+typedef enum MatrixIsa
+{
+  MATRIX_ISA_AUTO = -1,
+  MATRIX_ISA_SCALAR = 0,
+  MATRIX_ISA_SSE2,
+  MATRIX_ISA_AVX2,
+  MATRIX_ISA_AVX512
+} MatrixIsa;
+
+typedef struct MatrixKernels
+{
+  const char *name;
+  void (*add)(const MATRIX_TYPE *a, const MATRIX_TYPE *b, MATRIX_TYPE *out, size_t n);
+  double (*sum)(const MATRIX_TYPE *a, size_t n);
+  double (*sumReproducible)(const MATRIX_TYPE *a, size_t n);
+  double (*sumKahan)(const MATRIX_TYPE *a, size_t n);
+  void (*gemmMicro)(int kc, const MATRIX_TYPE *a, const MATRIX_TYPE *b,
+                    MATRIX_TYPE *C, int ldc, int mr, int nr, int accumulate);
+  void (*gemmMicroI8)(int kc2, const int16_t *a, const int16_t *b, float scale,
+                      MATRIX_TYPE *C, int ldc, int mr, int nr, int accumulate);
+  void (*fillUniform)(MATRIX_TYPE *out, size_t n, uint32_t lo, uint32_t k0, uint32_t hiMix);
+  void (*transpose8x8)(const MATRIX_TYPE *src, size_t lds, MATRIX_TYPE *dst, size_t ldd);
+} MatrixKernels;
+
+// Combine the 8 canonical lanes in a fixed tree
+static double sumLanes(const double *lane)
+{
+  return ((lane[0] + lane[1]) + (lane[2] + lane[3])) + ((lane[4] + lane[5]) + (lane[6] + lane[7]));
+}
+
+static void addScalar(const MATRIX_TYPE *a, const MATRIX_TYPE *b, MATRIX_TYPE *out, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = a[i] + b[i];
+}
+
+// dst[j][i] = src[i][j] for one 8 x 8 tile
+static void transpose8x8Scalar(const MATRIX_TYPE *src, size_t lds, MATRIX_TYPE *dst, size_t ldd)
+{
+  for (int i = 0; i < 8; i++)
+    for (int j = 0; j < 8; j++)
+      dst[j * ldd + i] = src[i * lds + j];
+}
+
+// Kahan step on one lane: c carries the low-order bits lost from s
+#define KAHAN_ADD(s, c, x)   \
+  do                         \
+  {                          \
+    double y_ = (x) - (c);   \
+    double t_ = (s) + y_;    \
+    (c) = (t_ - (s)) - y_;   \
+    (s) = t_;                \
+  } while (0)
+
+// Fold the 8 compensated lanes and the scalar tail in a fixed order
+static double kahanFinish(const double *sum, const double *comp, const MATRIX_TYPE *tail, size_t n)
+{
+  double s = 0.0, c = 0.0;
+  for (int l = 0; l < SUM_LANES; l++)
+  {
+    KAHAN_ADD(s, c, sum[l]);
+    KAHAN_ADD(s, c, -comp[l]);
+  }
+  for (size_t i = 0; i < n; i++)
+    KAHAN_ADD(s, c, tail[i]);
+  return s - c;
+}
+
+static double sumKahanScalar(const MATRIX_TYPE *a, size_t n)
+{
+  double sum[SUM_LANES] = {0}, comp[SUM_LANES] = {0};
+  size_t i = 0;
+  for (; i + SUM_LANES <= n; i += SUM_LANES)
+    for (int l = 0; l < SUM_LANES; l++)
+      KAHAN_ADD(sum[l], comp[l], a[i + l]);
+  return kahanFinish(sum, comp, a + i, n - i);
+}
+
+// lowbias32 integer hash (bijective, full avalanche); only 32-bit
+// multiplies and shifts, so the fill loop below vectorizes cleanly
+static inline uint32_t rngMix32(uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// out[j] = uniform [-1, 1) from counter (hi, lo + j); the caller keeps lo + j
+// from wrapping. The top 24 bits convert exactly, so every ISA gives the
+// same floats.
+static inline __attribute__((always_inline)) void fillUniformBody(MATRIX_TYPE *out, size_t n, uint32_t lo,
+                                                                   uint32_t k0, uint32_t hiMix)
+{
+  for (size_t j = 0; j < n; j++)
+  {
+    uint32_t x = rngMix32(rngMix32((lo + (uint32_t)j) ^ k0) + hiMix);
+    out[j] = (MATRIX_TYPE)(x >> 8) * (1.0f / 8388608.0f) - 1.0f;
   }
+}
+
+static void fillUniformScalar(MATRIX_TYPE *out, size_t n, uint32_t lo, uint32_t k0, uint32_t hiMix)
+{
+  fillUniformBody(out, n, lo, k0, hiMix);
+}
+
+static double sumReproducibleScalar(const MATRIX_TYPE *a, size_t n)
+{
+  double lane[SUM_LANES] = {0};
+  size_t i = 0;
+  for (; i + SUM_LANES <= n; i += SUM_LANES)
+    for (int l = 0; l < SUM_LANES; l++)
+      lane[l] += a[i + l];
 
-  for (int i = 0; i < A->rows; i++)
+  double sum = sumLanes(lane);
+  for (; i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+// MR x NR register block: C (+)= a_panel * b_panel over kc steps.
+// Only the top-left mr x nr corner is written back for edge tiles.
+static void gemmMicroKernelScalar(int kc, const MATRIX_TYPE *a, const MATRIX_TYPE *b,
+                            MATRIX_TYPE *C, int ldc, int mr, int nr, int accumulate)
+{
+  MATRIX_TYPE acc[GEMM_MR][GEMM_NR] = {{0}};
+  for (int p = 0; p < kc; p++)
   {
-    for (int j = 0; j < B->cols; j++)
+    for (int i = 0; i < GEMM_MR; i++)
     {
-      result->data[i * B->cols + j] = 0;
-      for (int k = 0; k < A->cols; k++)
-      {
-        result->data[i * B->cols + j] += A->data[i * A->cols + k] * B->data[k * B->cols + j];
-      }
+      const MATRIX_TYPE ai = a[i];
+      for (int j = 0; j < GEMM_NR; j++)
+        acc[i][j] += ai * b[j];
+    }
+    a += GEMM_MR;
+    b += GEMM_NR;
+  }
+
+  for (int i = 0; i < mr; i++)
+  {
+    MATRIX_TYPE *c = C + i * ldc;
+    if (accumulate)
+      for (int j = 0; j < nr; j++)
+        c[j] += acc[i][j];
+    else
+      for (int j = 0; j < nr; j++)
+        c[j] = acc[i][j];
+  }
+}
+
+// Int8 GEMM micro-kernel. Operands are packed as int16 pairs along k
+// (panel[k / 2][row or col][2]) so that one multiply-add of adjacent int16
+// pairs (pmaddwd) does two steps of k at once into int32. The int32 block
+// is exact; it is scaled into C once per kc block.
+static void gemmStoreI8(const int32_t *acc, float scale, MATRIX_TYPE *C, int ldc, int mr, int nr, int accumulate)
+{
+  for (int i = 0; i < mr; i++)
+  {
+    MATRIX_TYPE *c = C + (size_t)i * ldc;
+    const int32_t *row = acc + i * GEMM_NR;
+    if (accumulate)
+      for (int j = 0; j < nr; j++)
+        c[j] += scale * (float)row[j];
+    else
+      for (int j = 0; j < nr; j++)
+        c[j] = scale * (float)row[j];
+  }
+}
+
+static void gemmMicroKernelI8Scalar(int kc2, const int16_t *a, const int16_t *b, float scale,
+                                    MATRIX_TYPE *C, int ldc, int mr, int nr, int accumulate)
+{
+  int32_t acc[GEMM_I8_MR * GEMM_NR] = {0};
+  for (int q = 0; q < kc2; q++)
+  {
+    for (int i = 0; i < GEMM_I8_MR; i++)
+      for (int j = 0; j < GEMM_NR; j++)
+        acc[i * GEMM_NR + j] += a[2 * i] * b[2 * j] + a[2 * i + 1] * b[2 * j + 1];
+    a += 2 * GEMM_I8_MR;
+    b += 2 * GEMM_NR;
+  }
+  gemmStoreI8(acc, scale, C, ldc, mr, nr, accumulate);
+}
+
+#ifdef MATRIX_X86_KERNELS
+__attribute__((target("sse2"))) static void addSse2(const MATRIX_TYPE *a, const MATRIX_TYPE *b, MATRIX_TYPE *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  for (; i < n; i++)
+    out[i] = a[i] + b[i];
+}
+
+// Four 4 x 4 register transposes
+__attribute__((target("sse2"))) static void transpose8x8Sse2(const MATRIX_TYPE *src, size_t lds, MATRIX_TYPE *dst,
+                                                             size_t ldd)
+{
+  for (int bi = 0; bi < 8; bi += 4)
+    for (int bj = 0; bj < 8; bj += 4)
+    {
+      const MATRIX_TYPE *s = src + bi * lds + bj;
+      __m128 r0 = _mm_loadu_ps(s), r1 = _mm_loadu_ps(s + lds);
+      __m128 r2 = _mm_loadu_ps(s + 2 * lds), r3 = _mm_loadu_ps(s + 3 * lds);
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      MATRIX_TYPE *d = dst + bj * ldd + bi;
+      _mm_storeu_ps(d, r0);
+      _mm_storeu_ps(d + ldd, r1);
+      _mm_storeu_ps(d + 2 * ldd, r2);
+      _mm_storeu_ps(d + 3 * ldd, r3);
+    }
+}
+
+__attribute__((target("sse2"))) static double sumSse2(const MATRIX_TYPE *a, size_t n)
+{
+  __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128 x0 = _mm_loadu_ps(a + i);
+    __m128 x1 = _mm_loadu_ps(a + i + 4);
+    acc[0] = _mm_add_pd(acc[0], _mm_cvtps_pd(x0));
+    acc[1] = _mm_add_pd(acc[1], _mm_cvtps_pd(_mm_movehl_ps(x0, x0)));
+    acc[2] = _mm_add_pd(acc[2], _mm_cvtps_pd(x1));
+    acc[3] = _mm_add_pd(acc[3], _mm_cvtps_pd(_mm_movehl_ps(x1, x1)));
+  }
+
+  double lane[SUM_LANES];
+  for (int v = 0; v < 4; v++)
+    _mm_storeu_pd(lane + 2 * v, acc[v]);
+  double sum = sumLanes(lane);
+  for (; i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+// Same lane layout as sumReproducibleScalar: xmm v holds lanes 2v, 2v+1
+__attribute__((target("sse2"))) static double sumReproducibleSse2(const MATRIX_TYPE *a, size_t n)
+{
+  __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+  size_t i = 0;
+  for (; i + SUM_LANES <= n; i += SUM_LANES)
+  {
+    __m128 x0 = _mm_loadu_ps(a + i);
+    __m128 x1 = _mm_loadu_ps(a + i + 4);
+    acc[0] = _mm_add_pd(acc[0], _mm_cvtps_pd(x0));
+    acc[1] = _mm_add_pd(acc[1], _mm_cvtps_pd(_mm_movehl_ps(x0, x0)));
+    acc[2] = _mm_add_pd(acc[2], _mm_cvtps_pd(x1));
+    acc[3] = _mm_add_pd(acc[3], _mm_cvtps_pd(_mm_movehl_ps(x1, x1)));
+  }
+
+  double lane[SUM_LANES];
+  for (int v = 0; v < 4; v++)
+    _mm_storeu_pd(lane + 2 * v, acc[v]);
+  double sum = sumLanes(lane);
+  for (; i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+__attribute__((target("avx2"))) static void addAvx2(const MATRIX_TYPE *a, const MATRIX_TYPE *b, MATRIX_TYPE *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    _mm256_storeu_ps(out + i + 8, _mm256_add_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+  }
+  for (; i < n; i++)
+    out[i] = a[i] + b[i];
+}
+
+// 8 x 8 in registers: interleave pairs of rows, then pairs of pairs, then
+// swap 128-bit halves. The AVX-512 tier uses it as well.
+__attribute__((target("avx2"))) static void transpose8x8Avx2(const MATRIX_TYPE *src, size_t lds, MATRIX_TYPE *dst,
+                                                             size_t ldd)
+{
+  __m256 r[8], t[8];
+  for (int i = 0; i < 8; i++)
+    r[i] = _mm256_loadu_ps(src + i * lds);
+  for (int i = 0; i < 8; i += 2)
+  {
+    t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+    t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+  }
+  for (int i = 0; i < 8; i += 4)
+  {
+    r[i] = _mm256_shuffle_ps(t[i], t[i + 2], 0x44);
+    r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], 0xEE);
+    r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+    r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0xEE);
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    _mm256_storeu_ps(dst + i * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+    _mm256_storeu_ps(dst + (i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+  }
+}
+
+__attribute__((target("avx2"))) static double sumAvx2(const MATRIX_TYPE *a, size_t n)
+{
+  __m256d acc[4] = {_mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd()};
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    for (int v = 0; v < 4; v++)
+      acc[v] = _mm256_add_pd(acc[v], _mm256_cvtps_pd(_mm_loadu_ps(a + i + 4 * v)));
+
+  double lane[16];
+  for (int v = 0; v < 4; v++)
+    _mm256_storeu_pd(lane + 4 * v, acc[v]);
+  double sum = sumLanes(lane) + sumLanes(lane + 8);
+  for (; i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+__attribute__((target("avx2"))) static double sumReproducibleAvx2(const MATRIX_TYPE *a, size_t n)
+{
+  __m256d lo = _mm256_setzero_pd();
+  __m256d hi = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + SUM_LANES <= n; i += SUM_LANES)
+  {
+    lo = _mm256_add_pd(lo, _mm256_cvtps_pd(_mm_loadu_ps(a + i)));
+    hi = _mm256_add_pd(hi, _mm256_cvtps_pd(_mm_loadu_ps(a + i + 4)));
+  }
+
+  double lane[SUM_LANES];
+  _mm256_storeu_pd(lane, lo);
+  _mm256_storeu_pd(lane + 4, hi);
+  double sum = sumLanes(lane);
+  for (; i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+// Kahan lanes 0-3 and 4-7, same order as sumKahanScalar
+__attribute__((target("avx2"))) static double sumKahanAvx2(const MATRIX_TYPE *a, size_t n)
+{
+  __m256d sum[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  __m256d comp[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  size_t i = 0;
+  for (; i + SUM_LANES <= n; i += SUM_LANES)
+  {
+    for (int v = 0; v < 2; v++)
+    {
+      __m256d y = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4 * v)), comp[v]);
+      __m256d t = _mm256_add_pd(sum[v], y);
+      comp[v] = _mm256_sub_pd(_mm256_sub_pd(t, sum[v]), y);
+      sum[v] = t;
+    }
+  }
+
+  double s[SUM_LANES], c[SUM_LANES];
+  for (int v = 0; v < 2; v++)
+  {
+    _mm256_storeu_pd(s + 4 * v, sum[v]);
+    _mm256_storeu_pd(c + 4 * v, comp[v]);
+  }
+  return kahanFinish(s, c, a + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void fillUniformAvx2(MATRIX_TYPE *out, size_t n, uint32_t lo, uint32_t k0, uint32_t hiMix)
+{
+  fillUniformBody(out, n, lo, k0, hiMix);
+}
+
+// 6x16 block in 12 ymm accumulators
+__attribute__((target("avx2,fma"))) static void gemmMicroKernelAvx2(int kc, const MATRIX_TYPE *a, const MATRIX_TYPE *b,
+                                                                    MATRIX_TYPE *C, int ldc, int mr, int nr, int accumulate)
+{
+  __m256 acc[GEMM_MR][2];
+  for (int i = 0; i < GEMM_MR; i++)
+    acc[i][0] = acc[i][1] = _mm256_setzero_ps();
+
+  for (int p = 0; p < kc; p++)
+  {
+    __m256 b0 = _mm256_loadu_ps(b);
+    __m256 b1 = _mm256_loadu_ps(b + 8);
+    for (int i = 0; i < GEMM_MR; i++)
+    {
+      __m256 ai = _mm256_broadcast_ss(a + i);
+      acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+      acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+    }
+    a += GEMM_MR;
+    b += GEMM_NR;
+  }
+
+  if (mr == GEMM_MR && nr == GEMM_NR)
+  {
+    for (int i = 0; i < GEMM_MR; i++)
+    {
+      MATRIX_TYPE *c = C + i * ldc;
+      if (accumulate)
+      {
+        acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_loadu_ps(c));
+        acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_loadu_ps(c + 8));
+      }
+      _mm256_storeu_ps(c, acc[i][0]);
+      _mm256_storeu_ps(c + 8, acc[i][1]);
+    }
+    return;
+  }
+
+  MATRIX_TYPE tile[GEMM_MR][GEMM_NR];
+  for (int i = 0; i < GEMM_MR; i++)
+  {
+    _mm256_storeu_ps(tile[i], acc[i][0]);
+    _mm256_storeu_ps(tile[i] + 8, acc[i][1]);
+  }
+  for (int i = 0; i < mr; i++)
+    for (int j = 0; j < nr; j++)
+      C[i * ldc + j] = accumulate ? C[i * ldc + j] + tile[i][j] : tile[i][j];
+}
+
+__attribute__((target("avx512f"))) static void addAvx512(const MATRIX_TYPE *a, const MATRIX_TYPE *b, MATRIX_TYPE *out, size_t n)
+{
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+  if (i < n)
+  {
+    __mmask16 tail = (__mmask16)((1u << (n - i)) - 1);
+    _mm512_mask_storeu_ps(out + i, tail, _mm512_add_ps(_mm512_maskz_loadu_ps(tail, a + i), _mm512_maskz_loadu_ps(tail, b + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) static double sumAvx512(const MATRIX_TYPE *a, size_t n)
+{
+  __m512d acc[4] = {_mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd()};
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32)
+    for (int v = 0; v < 4; v++)
+      acc[v] = _mm512_add_pd(acc[v], _mm512_cvtps_pd(_mm256_loadu_ps(a + i + 8 * v)));
+
+  double sum = _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(acc[0], acc[1]), _mm512_add_pd(acc[2], acc[3])));
+  for (; i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+__attribute__((target("avx512f"))) static double sumReproducibleAvx512(const MATRIX_TYPE *a, size_t n)
+{
+  __m512d acc = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + SUM_LANES <= n; i += SUM_LANES)
+    acc = _mm512_add_pd(acc, _mm512_cvtps_pd(_mm256_loadu_ps(a + i)));
+
+  double lane[SUM_LANES];
+  _mm512_storeu_pd(lane, acc);
+  double sum = sumLanes(lane);
+  for (; i < n; i++)
+    sum += a[i];
+  return sum;
+}
+
+__attribute__((target("avx512f"))) static double sumKahanAvx512(const MATRIX_TYPE *a, size_t n)
+{
+  __m512d sum = _mm512_setzero_pd();
+  __m512d comp = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + SUM_LANES <= n; i += SUM_LANES)
+  {
+    __m512d y = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(a + i)), comp);
+    __m512d t = _mm512_add_pd(sum, y);
+    comp = _mm512_sub_pd(_mm512_sub_pd(t, sum), y);
+    sum = t;
+  }
+
+  double s[SUM_LANES], c[SUM_LANES];
+  _mm512_storeu_pd(s, sum);
+  _mm512_storeu_pd(c, comp);
+  return kahanFinish(s, c, a + i, n - i);
+}
+
+__attribute__((target("avx512f"))) static void fillUniformAvx512(MATRIX_TYPE *out, size_t n, uint32_t lo, uint32_t k0, uint32_t hiMix)
+{
+  fillUniformBody(out, n, lo, k0, hiMix);
+}
+
+// 6x16 block in 6 zmm accumulators
+__attribute__((target("avx512f"))) static void gemmMicroKernelAvx512(int kc, const MATRIX_TYPE *a, const MATRIX_TYPE *b,
+                                                                     MATRIX_TYPE *C, int ldc, int mr, int nr, int accumulate)
+{
+  __m512 acc[GEMM_MR];
+  for (int i = 0; i < GEMM_MR; i++)
+    acc[i] = _mm512_setzero_ps();
+
+  for (int p = 0; p < kc; p++)
+  {
+    __m512 bv = _mm512_loadu_ps(b);
+    for (int i = 0; i < GEMM_MR; i++)
+      acc[i] = _mm512_fmadd_ps(_mm512_set1_ps(a[i]), bv, acc[i]);
+    a += GEMM_MR;
+    b += GEMM_NR;
+  }
+
+  __mmask16 cols = nr == GEMM_NR ? (__mmask16)0xFFFF : (__mmask16)((1u << nr) - 1);
+  for (int i = 0; i < mr; i++)
+  {
+    MATRIX_TYPE *c = C + i * ldc;
+    if (accumulate)
+      acc[i] = _mm512_add_ps(acc[i], _mm512_maskz_loadu_ps(cols, c));
+    _mm512_mask_storeu_ps(c, cols, acc[i]);
+  }
+}
+// Int8 8x16 block as two 4-row halves, 8 ymm accumulators each
+__attribute__((target("avx2"))) static void gemmMicroKernelI8Avx2(int kc2, const int16_t *a, const int16_t *b, float scale,
+                                                                  MATRIX_TYPE *C, int ldc, int mr, int nr, int accumulate)
+{
+  int32_t out[GEMM_I8_MR * GEMM_NR];
+  for (int half = 0; half < GEMM_I8_MR; half += 4)
+  {
+    __m256i acc[4][2];
+    for (int i = 0; i < 4; i++)
+      acc[i][0] = acc[i][1] = _mm256_setzero_si256();
+
+    const int16_t *ap = a + 2 * half, *bp = b;
+    for (int q = 0; q < kc2; q++)
+    {
+      __m256i b0 = _mm256_loadu_si256((const __m256i *)bp);
+      __m256i b1 = _mm256_loadu_si256((const __m256i *)(bp + 16));
+      for (int i = 0; i < 4; i++)
+      {
+        int32_t pair;
+        memcpy(&pair, ap + 2 * i, sizeof(pair));
+        __m256i av = _mm256_set1_epi32(pair);
+        acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_madd_epi16(b0, av));
+        acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_madd_epi16(b1, av));
+      }
+      ap += 2 * GEMM_I8_MR;
+      bp += 2 * GEMM_NR;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+      _mm256_storeu_si256((__m256i *)(out + (half + i) * GEMM_NR), acc[i][0]);
+      _mm256_storeu_si256((__m256i *)(out + (half + i) * GEMM_NR + 8), acc[i][1]);
+    }
+  }
+  gemmStoreI8(out, scale, C, ldc, mr, nr, accumulate);
+}
+
+// Int8 8x16 block in 8 zmm accumulators
+__attribute__((target("avx512f,avx512bw"))) static void gemmMicroKernelI8Avx512(int kc2, const int16_t *a, const int16_t *b,
+                                                                                float scale, MATRIX_TYPE *C, int ldc,
+                                                                                int mr, int nr, int accumulate)
+{
+  __m512i acc[GEMM_I8_MR];
+  for (int i = 0; i < GEMM_I8_MR; i++)
+    acc[i] = _mm512_setzero_si512();
+
+  for (int q = 0; q < kc2; q++)
+  {
+    __m512i bv = _mm512_loadu_si512((const void *)b);
+    for (int i = 0; i < GEMM_I8_MR; i++)
+    {
+      int32_t pair;
+      memcpy(&pair, a + 2 * i, sizeof(pair));
+      acc[i] = _mm512_add_epi32(acc[i], _mm512_madd_epi16(bv, _mm512_set1_epi32(pair)));
+    }
+    a += 2 * GEMM_I8_MR;
+    b += 2 * GEMM_NR;
+  }
+
+  int32_t out[GEMM_I8_MR * GEMM_NR];
+  for (int i = 0; i < GEMM_I8_MR; i++)
+    _mm512_storeu_si512((void *)(out + i * GEMM_NR), acc[i]);
+  gemmStoreI8(out, scale, C, ldc, mr, nr, accumulate);
+}
+#endif // MATRIX_X86_KERNELS
+
+static const MatrixKernels matrixKernelTable[] = {
+    {"scalar", addScalar, sumReproducibleScalar, sumReproducibleScalar, sumKahanScalar, gemmMicroKernelScalar,
+     gemmMicroKernelI8Scalar, fillUniformScalar, transpose8x8Scalar},
+#ifdef MATRIX_X86_KERNELS
+    {"sse2", addSse2, sumSse2, sumReproducibleSse2, sumKahanScalar, gemmMicroKernelScalar,
+     gemmMicroKernelI8Scalar, fillUniformScalar, transpose8x8Sse2},
+    {"avx2", addAvx2, sumAvx2, sumReproducibleAvx2, sumKahanAvx2, gemmMicroKernelAvx2,
+     gemmMicroKernelI8Avx2, fillUniformAvx2, transpose8x8Avx2},
+    {"avx512", addAvx512, sumAvx512, sumReproducibleAvx512, sumKahanAvx512, gemmMicroKernelAvx512,
+     gemmMicroKernelI8Avx512, fillUniformAvx512, transpose8x8Avx2},
+#endif
+};
+
+static const MatrixKernels *activeKernels = NULL;
+static int reproducibleMode = 0;
+
+static MatrixIsa detectMatrixIsa(void)
+{
+#ifdef MATRIX_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return MATRIX_ISA_AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return MATRIX_ISA_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return MATRIX_ISA_SSE2;
+#endif
+  return MATRIX_ISA_SCALAR;
+}
+
+// Pick the kernel set; requests above what the CPU supports are clamped.
+// Returns the ISA actually in use.
+MatrixIsa matrixSelectKernels(MatrixIsa isa)
+{
+  MatrixIsa best = detectMatrixIsa();
+  if (isa == MATRIX_ISA_AUTO || isa > best)
+    isa = best;
+  activeKernels = &matrixKernelTable[isa];
+  return isa;
+}
+
+static const MatrixKernels *matrixKernels(void)
+{
+  if (!activeKernels)
+    matrixSelectKernels(MATRIX_ISA_AUTO);
+  return activeKernels;
+}
+
+const char *matrixKernelName(void)
+{
+  return matrixKernels()->name;
+}
+
+// Bit-reproducible sums/means across ISAs (slower: one chain per lane).
+// Kahan sums always use the canonical lanes and need no extra mode.
+void matrixSetReproducible(int enabled)
+{
+  reproducibleMode = enabled != 0;
+}
+
+// Thread pool
+// Workers are started once (lazily, on the first call big enough to split)
+// and then sleep on a condition variable between jobs. A job is a number of
+// independent tasks handed out through an atomic counter; the calling thread
+// works as worker 0 and returns once every task has run. Jobs smaller than
+// the parallel threshold, and jobs issued from inside a task, run inline.
+//
+// Operations may be called from any number of threads at once. The pool
+// runs one job at a time: a thread outside the pool holds submitLock from
+// submitting a job, inline or not, until its last task has run, so other
+// callers wait their turn. Per-worker scratch such as gemmScratch is only
+// touched while the lock is held. matrixSetNumThreads and
+// matrixStopThreads must not run while other threads are using the pool.
+#define MATRIX_MAX_THREADS 256
+#define MATRIX_PARALLEL_THRESHOLD ((size_t)1 << 18) // elements, or multiply-adds for GEMM
+
+typedef void (*MatrixTaskFn)(void *ctx, int task, int worker);
+
+typedef struct MatrixPool
+{
+  pthread_t threads[MATRIX_MAX_THREADS];
+  int numThreads; // including the calling thread, 0 until started
+  int requestedThreads;
+  size_t threshold;
+  pthread_mutex_t submitLock; // one job at a time, see above
+  pthread_mutex_t startLock;  // guards numThreads
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t finished;
+  unsigned generation;
+  unsigned startGeneration; // generation current when the workers were created
+  int busyWorkers;
+  int shutdown;
+  MatrixTaskFn fn;
+  void *ctx;
+  int numTasks;
+  atomic_int nextTask;
+} MatrixPool;
+
+static MatrixPool matrixPool = {
+    .threshold = MATRIX_PARALLEL_THRESHOLD,
+    .submitLock = PTHREAD_MUTEX_INITIALIZER,
+    .startLock = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER,
+};
+static _Thread_local int matrixWorkerId = 0;
+static _Thread_local int matrixInTask = 0;
+static _Thread_local int matrixHoldsPool = 0; // submitLock depth of this thread
+
+// Take the pool for a job; nested jobs and tasks already run under it
+static void matrixPoolAcquire(void)
+{
+  if (!matrixInTask && matrixHoldsPool++ == 0)
+    pthread_mutex_lock(&matrixPool.submitLock);
+}
+
+static void matrixPoolRelease(void)
+{
+  if (!matrixInTask && --matrixHoldsPool == 0)
+    pthread_mutex_unlock(&matrixPool.submitLock);
+}
+
+static int hardwareThreads(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+static void poolRunTasks(MatrixPool *pool, int worker)
+{
+  int task;
+  while ((task = atomic_fetch_add(&pool->nextTask, 1)) < pool->numTasks)
+    pool->fn(pool->ctx, task, worker);
+}
+
+static void *poolWorker(void *arg)
+{
+  MatrixPool *pool = &matrixPool;
+  matrixWorkerId = (int)(intptr_t)arg;
+  matrixInTask = 1;
+
+  pthread_mutex_lock(&pool->lock);
+  unsigned seen = pool->startGeneration;
+  for (;;)
+  {
+    while (pool->generation == seen && !pool->shutdown)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->shutdown)
+      break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    poolRunTasks(pool, matrixWorkerId);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busyWorkers == 0)
+      pthread_cond_signal(&pool->finished);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+// Number of workers including the caller; starts the pool on first use.
+// The count comes from matrixSetNumThreads(), else MATRIX_NUM_THREADS, else
+// the number of online CPUs.
+int matrixNumThreads(void)
+{
+  MatrixPool *pool = &matrixPool;
+  pthread_mutex_lock(&pool->startLock);
+  if (pool->numThreads)
+  {
+    pthread_mutex_unlock(&pool->startLock);
+    return pool->numThreads;
+  }
+
+  int n = pool->requestedThreads;
+  const char *env = getenv("MATRIX_NUM_THREADS");
+  if (n <= 0 && env)
+    n = atoi(env);
+  if (n <= 0)
+    n = hardwareThreads();
+  if (n > MATRIX_MAX_THREADS)
+    n = MATRIX_MAX_THREADS;
+
+  pool->shutdown = 0;
+  pool->startGeneration = pool->generation;
+  pool->numThreads = 1;
+  for (int t = 1; t < n; t++)
+  {
+    if (pthread_create(&pool->threads[t], NULL, poolWorker, (void *)(intptr_t)t) != 0)
+    {
+      fprintf(stderr, "Error: Could only start %d of %d matrix worker threads.\n", t, n);
+      break;
+    }
+    pool->numThreads++;
+  }
+  n = pool->numThreads;
+  pthread_mutex_unlock(&pool->startLock);
+  return n;
+}
+
+void matrixStopThreads(void)
+{
+  MatrixPool *pool = &matrixPool;
+  pthread_mutex_lock(&pool->startLock);
+  if (pool->numThreads > 1)
+  {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 1; t < pool->numThreads; t++)
+      pthread_join(pool->threads[t], NULL);
+  }
+  pool->numThreads = 0;
+  pthread_mutex_unlock(&pool->startLock);
+}
+
+// 0 selects the default; a running pool is restarted with the new count
+void matrixSetNumThreads(int numThreads)
+{
+  matrixStopThreads();
+  matrixPool.requestedThreads = numThreads;
+}
+
+// Jobs with less work than this stay on the calling thread
+void matrixSetParallelThreshold(size_t work)
+{
+  matrixPool.threshold = work;
+}
+
+// Number of workers a job of the given size will be spread over
+static int matrixWorkersFor(size_t work)
+{
+  if (matrixInTask || work < matrixPool.threshold)
+    return 1;
+  return matrixNumThreads();
+}
+
+// Run fn(ctx, task, worker) for every task in [0, numTasks)
+static void matrixParallelFor(int numTasks, MatrixTaskFn fn, void *ctx, size_t work)
+{
+  MatrixPool *pool = &matrixPool;
+  matrixPoolAcquire();
+  if (numTasks <= 1 || matrixWorkersFor(work) <= 1)
+  {
+    for (int task = 0; task < numTasks; task++)
+      fn(ctx, task, matrixWorkerId);
+    matrixPoolRelease();
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->ctx = ctx;
+  pool->numTasks = numTasks;
+  atomic_store(&pool->nextTask, 0);
+  pool->busyWorkers = pool->numThreads - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  matrixInTask = 1;
+  poolRunTasks(pool, 0);
+  matrixInTask = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busyWorkers > 0)
+    pthread_cond_wait(&pool->finished, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+  matrixPoolRelease();
+}
+
+// Split [0, n) into one range per worker, aligned to 16 elements (64 bytes)
+static size_t matrixChunkSize(size_t n, int workers)
+{
+  size_t chunk = (n + workers - 1) / workers;
+  return (chunk + 15) & ~(size_t)15;
+}
+
+// Matrix operations
+// Contiguous operands are added as one flat range; views go row by row
+typedef struct AddTask
+{
+  const MATRIX_TYPE *a;
+  const MATRIX_TYPE *b;
+  MATRIX_TYPE *out;
+  size_t n;
+  size_t chunk;
+  const Matrix_t *A, *B, *C; // strided operands, chunk counts rows
+} AddTask;
+
+static void addTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  AddTask *t = (AddTask *)ctx;
+  size_t begin = (size_t)task * t->chunk;
+  size_t end = begin + t->chunk < t->n ? begin + t->chunk : t->n;
+  if (!t->C)
+  {
+    matrixKernels()->add(t->a + begin, t->b + begin, t->out + begin, end - begin);
+    return;
+  }
+
+  const Matrix_t *A = t->A, *B = t->B, *C = t->C;
+  for (size_t i = begin; i < end; i++)
+  {
+    if (A->colStride == 1 && B->colStride == 1 && C->colStride == 1)
+      matrixKernels()->add(&MATRIX_AT(A, i, 0), &MATRIX_AT(B, i, 0), &MATRIX_AT(C, i, 0), (size_t)C->cols);
+    else
+      for (int j = 0; j < C->cols; j++)
+        MATRIX_AT(C, i, j) = MATRIX_AT(A, i, j) + MATRIX_AT(B, i, j);
+  }
+}
+
+// result = A + B into caller-provided storage (may alias A or B exactly)
+int addMatricesInto(const Matrix_t *A, const Matrix_t *B, Matrix_t *result)
+{
+  if (A->rows != B->rows || A->cols != B->cols)
+  {
+    fprintf(stderr, "Error: Matrices must have the same dimensions for addition.\n");
+    return -1;
+  }
+
+  if (!result || !result->data || result->rows != A->rows || result->cols != A->cols)
+  {
+    fprintf(stderr, "Error: Result matrix must be %dx%d for addition.\n", A->rows, A->cols);
+    return -1;
+  }
+
+  if (matrixRequireF32(A, "Addition") || matrixRequireF32(B, "Addition") || matrixRequireF32(result, "Addition") ||
+      matrixRequireWritable(result, "Addition"))
+    return -1;
+
+  size_t n = (size_t)A->rows * A->cols;
+  if (matrixIsContiguous(A) && matrixIsContiguous(B) && matrixIsContiguous(result))
+  {
+    AddTask task = {A->data, B->data, result->data, n, matrixChunkSize(n, matrixWorkersFor(n)), NULL, NULL, NULL};
+    if (n > 0)
+      matrixParallelFor((int)((n + task.chunk - 1) / task.chunk), addTaskRun, &task, n);
+    return 0;
+  }
+
+  // All column-major: add the transposes so that rows are unit-stride
+  Matrix_t a = *A, b = *B, c = *result;
+  if (A->colStride != 1 && B->colStride != 1 && result->colStride != 1)
+  {
+    a = matrixTransposeView(A);
+    b = matrixTransposeView(B);
+    c = matrixTransposeView(result);
+  }
+  int workers = matrixWorkersFor(n);
+  size_t chunk = ((size_t)c.rows + workers - 1) / workers;
+  AddTask task = {NULL, NULL, NULL, (size_t)c.rows, chunk ? chunk : 1, &a, &b, &c};
+  matrixParallelFor((int)((task.n + task.chunk - 1) / task.chunk), addTaskRun, &task, n);
+  return 0;
+}
+
+Matrix_t *addMatrices(const Matrix_t *A, const Matrix_t *B)
+{
+  if (A->rows != B->rows || A->cols != B->cols)
+  {
+    fprintf(stderr, "Error: Matrices must have the same dimensions for addition.\n");
+    return NULL;
+  }
+
+  Matrix_t *result = newMatrix(A->rows, A->cols);
+  if (!result)
+  {
+    return NULL;
+  }
+
+  if (addMatricesInto(A, B, result) != 0)
+  {
+    deleteMatrix(result);
+    return NULL;
+  }
+  return result;
+}
+
+// Transpose
+// Cache-oblivious: a block is halved along its longer side until it fits in
+// TRANSPOSE_LEAF x TRANSPOSE_LEAF, so the rows read and the rows written
+// stay cached at every level without tuning for any cache size, and a leaf
+// is moved in 8 x 8 register tiles. A square matrix is transposed in place
+// by swapping each block above the diagonal with its mirror image.
+// Operands are row-major float pointers here; the public functions below
+// reduce views to that.
+#define TRANSPOSE_TILE 8
+#define TRANSPOSE_LEAF 64
+#define TRANSPOSE_STRIP 64 // rows per parallel task
+
+// Split point of n: about half, on a tile boundary
+static int transposeSplit(int n)
+{
+  return (n / 2 + TRANSPOSE_TILE - 1) & ~(TRANSPOSE_TILE - 1);
+}
+
+// dst (cols x rows) = src (rows x cols)^T
+static void transposeRecurse(const MATRIX_TYPE *src, size_t lds, MATRIX_TYPE *dst, size_t ldd, int rows, int cols)
+{
+  if (rows > TRANSPOSE_LEAF && rows >= cols)
+  {
+    int h = transposeSplit(rows);
+    transposeRecurse(src, lds, dst, ldd, h, cols);
+    transposeRecurse(src + h * lds, lds, dst + h, ldd, rows - h, cols);
+    return;
+  }
+  if (cols > TRANSPOSE_LEAF)
+  {
+    int h = transposeSplit(cols);
+    transposeRecurse(src, lds, dst, ldd, rows, h);
+    transposeRecurse(src + h, lds, dst + h * ldd, ldd, rows, cols - h);
+    return;
+  }
+
+  const MatrixKernels *k = matrixKernels();
+  int i = 0;
+  for (; i + TRANSPOSE_TILE <= rows; i += TRANSPOSE_TILE)
+  {
+    int j = 0;
+    for (; j + TRANSPOSE_TILE <= cols; j += TRANSPOSE_TILE)
+      k->transpose8x8(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+    for (; j < cols; j++)
+      for (int ii = i; ii < i + TRANSPOSE_TILE; ii++)
+        dst[j * ldd + ii] = src[ii * lds + j];
+  }
+  for (; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+      dst[j * ldd + i] = src[i * lds + j];
+}
+
+// Swap the rows x cols block X at (r0, c0) with the transpose of its mirror
+// Y at (c0, r0) in a square matrix with leading dimension ld; X and Y must
+// not overlap (the block lies strictly on one side of the diagonal)
+static void transposeSwapRecurse(MATRIX_TYPE *a, size_t ld, int r0, int c0, int rows, int cols)
+{
+  if (rows > TRANSPOSE_LEAF && rows >= cols)
+  {
+    int h = transposeSplit(rows);
+    transposeSwapRecurse(a, ld, r0, c0, h, cols);
+    transposeSwapRecurse(a, ld, r0 + h, c0, rows - h, cols);
+    return;
+  }
+  if (cols > TRANSPOSE_LEAF)
+  {
+    int h = transposeSplit(cols);
+    transposeSwapRecurse(a, ld, r0, c0, rows, h);
+    transposeSwapRecurse(a, ld, r0, c0 + h, rows, cols - h);
+    return;
+  }
+
+  const MatrixKernels *k = matrixKernels();
+  MATRIX_TYPE tile[TRANSPOSE_TILE * TRANSPOSE_TILE];
+  int i = 0;
+  for (; i + TRANSPOSE_TILE <= rows; i += TRANSPOSE_TILE)
+  {
+    int j = 0;
+    for (; j + TRANSPOSE_TILE <= cols; j += TRANSPOSE_TILE)
+    {
+      MATRIX_TYPE *x = a + (size_t)(r0 + i) * ld + c0 + j, *y = a + (size_t)(c0 + j) * ld + r0 + i;
+      k->transpose8x8(x, ld, tile, TRANSPOSE_TILE);
+      k->transpose8x8(y, ld, x, ld);
+      for (int t = 0; t < TRANSPOSE_TILE; t++)
+        memcpy(y + t * ld, tile + t * TRANSPOSE_TILE, sizeof(tile) / TRANSPOSE_TILE);
+    }
+    for (; j < cols; j++)
+      for (int ii = i; ii < i + TRANSPOSE_TILE; ii++)
+      {
+        MATRIX_TYPE *x = a + (size_t)(r0 + ii) * ld + c0 + j, *y = a + (size_t)(c0 + j) * ld + r0 + ii;
+        MATRIX_TYPE v = *x;
+        *x = *y;
+        *y = v;
+      }
+  }
+  for (; i < rows; i++)
+    for (int j = 0; j < cols; j++)
+    {
+      MATRIX_TYPE *x = a + (size_t)(r0 + i) * ld + c0 + j, *y = a + (size_t)(c0 + j) * ld + r0 + i;
+      MATRIX_TYPE v = *x;
+      *x = *y;
+      *y = v;
+    }
+}
+
+// In place transpose of the n x n diagonal block at (r0, r0)
+static void transposeDiagRecurse(MATRIX_TYPE *a, size_t ld, int r0, int n)
+{
+  if (n > TRANSPOSE_LEAF)
+  {
+    int h = transposeSplit(n);
+    transposeDiagRecurse(a, ld, r0, h);
+    transposeDiagRecurse(a, ld, r0 + h, n - h);
+    transposeSwapRecurse(a, ld, r0, r0 + h, h, n - h);
+    return;
+  }
+  for (int i = 0; i < n; i++)
+    for (int j = i + 1; j < n; j++)
+    {
+      MATRIX_TYPE *x = a + (size_t)(r0 + i) * ld + r0 + j, *y = a + (size_t)(r0 + j) * ld + r0 + i;
+      MATRIX_TYPE v = *x;
+      *x = *y;
+      *y = v;
+    }
+}
+
+typedef struct TransposeTask
+{
+  const MATRIX_TYPE *src;
+  size_t lds;
+  MATRIX_TYPE *dst; // equal to src for in place
+  size_t ldd;
+  int rows, cols;
+} TransposeTask;
+
+// One strip of TRANSPOSE_STRIP source rows; in place, the strip's diagonal
+// block plus everything to its right
+static void transposeTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  TransposeTask *t = (TransposeTask *)ctx;
+  int r0 = task * TRANSPOSE_STRIP;
+  int rows = t->rows - r0 < TRANSPOSE_STRIP ? t->rows - r0 : TRANSPOSE_STRIP;
+  if (t->dst != t->src)
+  {
+    transposeRecurse(t->src + r0 * t->lds, t->lds, t->dst + r0, t->ldd, rows, t->cols);
+    return;
+  }
+  transposeDiagRecurse(t->dst, t->ldd, r0, rows);
+  if (r0 + rows < t->cols)
+    transposeSwapRecurse(t->dst, t->ldd, r0, r0 + rows, rows, t->cols - r0 - rows);
+}
+
+static void transposeRun(TransposeTask *task)
+{
+  size_t work = (size_t)task->rows * task->cols;
+  matrixParallelFor((task->rows + TRANSPOSE_STRIP - 1) / TRANSPOSE_STRIP, transposeTaskRun, task, work);
+}
+
+// Transpose a square matrix or view where it is
+int transposeMatrixInPlace(Matrix_t *matrix)
+{
+  if (!matrix || !matrix->data || matrix->rows != matrix->cols)
+  {
+    fprintf(stderr, "Error: In-place transpose needs a square matrix; use transposeMatrixInto.\n");
+    return -1;
+  }
+  if (matrixRequireF32(matrix, "Transpose") || matrixRequireWritable(matrix, "Transpose"))
+    return -1;
+
+  // Transposing a column-major view is the same operation on its storage
+  size_t ld = matrix->colStride == 1 ? (size_t)matrix->rowStride : (size_t)matrix->colStride;
+  TransposeTask task = {matrix->data, ld, matrix->data, ld, matrix->rows, matrix->cols};
+  transposeRun(&task);
+  return 0;
+}
+
+// result = src^T into caller-provided cols x rows storage. result may be
+// src itself when src is square; otherwise they must not overlap.
+int transposeMatrixInto(const Matrix_t *src, Matrix_t *result)
+{
+  if (!src || !src->data || !result || !result->data || result->rows != src->cols || result->cols != src->rows)
+  {
+    fprintf(stderr, "Error: Result matrix must be %dx%d for transpose.\n", src ? src->cols : 0, src ? src->rows : 0);
+    return -1;
+  }
+  if (matrixRequireF32(src, "Transpose") || matrixRequireF32(result, "Transpose") ||
+      matrixRequireWritable(result, "Transpose"))
+    return -1;
+
+  if (result->data == src->data && result->rowStride == src->rowStride && result->colStride == src->colStride)
+    return transposeMatrixInPlace(result);
+  if (matrixOverlaps(result, src))
+  {
+    fprintf(stderr, "Error: Transpose result must be the source itself or not overlap it.\n");
+    return -1;
+  }
+
+  // With exactly one operand column-major the transpose is a row copy
+  Matrix_t s = *src, d = *result;
+  if ((s.colStride == 1) != (d.colStride == 1))
+  {
+    Matrix_t dt = matrixTransposeView(result);
+    return copyMatrixInto(src, &dt);
+  }
+  // Both column-major: transpose their row-major storage instead
+  if (s.colStride != 1)
+  {
+    s = matrixTransposeView(src);
+    d = matrixTransposeView(result);
+  }
+  TransposeTask task = {s.data, (size_t)s.rowStride, d.data, (size_t)d.rowStride, s.rows, s.cols};
+  transposeRun(&task);
+  return 0;
+}
+
+Matrix_t *transposeMatrix(const Matrix_t *src)
+{
+  Matrix_t *result = newMatrix(src->cols, src->rows);
+  if (!result)
+    return NULL;
+  if (transposeMatrixInto(src, result) != 0)
+  {
+    deleteMatrix(result);
+    return NULL;
+  }
+  return result;
+}
+
+// GEMM engine
+// C = A * B is computed Goto-style: B is packed into KC x NC panels (L3),
+// A into MC x KC blocks (L2), and a MR x NR register-blocked micro-kernel
+// streams KC-long micro-panels of both (L1). Packing turns the column walk
+// over B into unit-stride reads and pads edge tiles with zeros.
+#define GEMM_MC 144  // multiple of GEMM_MR
+#define GEMM_KC 256
+#define GEMM_NC 4080 // multiple of GEMM_NR
+
+typedef struct GemmScratch
+{
+  MATRIX_TYPE *packA; // GEMM_MC * GEMM_KC
+  MATRIX_TYPE *packB; // GEMM_KC * GEMM_NC
+} GemmScratch;
+
+static GemmScratch gemmScratch[MATRIX_MAX_THREADS]; // one per worker
+
+// Allocated on the calling thread so that tasks never fail
+static int gemmReserveBuffers(int workers)
+{
+  int ok = 1;
+  matrixPoolAcquire();
+  for (int w = 0; ok && w < workers; w++)
+  {
+    if (!gemmScratch[w].packA)
+      gemmScratch[w].packA = (MATRIX_TYPE *)malloc(sizeof(MATRIX_TYPE) * GEMM_MC * GEMM_KC);
+    if (!gemmScratch[w].packB)
+      gemmScratch[w].packB = (MATRIX_TYPE *)malloc(sizeof(MATRIX_TYPE) * GEMM_KC * GEMM_NC);
+    ok = gemmScratch[w].packA && gemmScratch[w].packB;
+  }
+  matrixPoolRelease();
+  return ok;
+}
+
+// A GEMM operand: element (i, p) is element i * rs + p * cs of data, of
+// any dtype. Packing widens it to float, so the kernels only see floats.
+typedef struct GemmOperand
+{
+  const void *data;
+  size_t rs, cs;
+  MatrixDtype dtype;
+  float scale;
+} GemmOperand;
+
+static GemmOperand gemmOperand(const void *data, size_t rs, size_t cs, MatrixDtype dtype, float scale)
+{
+  GemmOperand op = {data, rs, cs, dtype, scale};
+  return op;
+}
+
+// Pack the mc x kc block of A at (i0, p0) into row micro-panels: panel[k][0..MR)
+static void gemmPackBlockA(int mc, int kc, const GemmOperand *A, size_t i0, size_t p0, MATRIX_TYPE *packed)
+{
+  size_t rs = A->rs, cs = A->cs;
+  // Transposed A (columns unit-stride): read each source column once and
+  // deal it out across the micro-panels
+  if (A->dtype == MATRIX_F32 && rs == 1 && cs != 1)
+  {
+    for (int p = 0; p < kc; p++)
+    {
+      const MATRIX_TYPE *src = (const MATRIX_TYPE *)A->data + i0 + (p0 + p) * cs;
+      for (int ir = 0; ir < mc; ir += GEMM_MR)
+      {
+        int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+        MATRIX_TYPE *dst = packed + (size_t)ir * kc + (size_t)p * GEMM_MR;
+        for (int i = 0; i < mr; i++)
+          dst[i] = src[ir + i];
+        for (int i = mr; i < GEMM_MR; i++)
+          dst[i] = 0;
+      }
+    }
+    return;
+  }
+
+  for (int ir = 0; ir < mc; ir += GEMM_MR)
+  {
+    int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+    for (int p = 0; p < kc; p++)
+    {
+      size_t col = (i0 + ir) * rs + (p0 + p) * cs;
+      if (A->dtype == MATRIX_F32)
+        for (int i = 0; i < mr; i++)
+          packed[i] = ((const MATRIX_TYPE *)A->data)[col + i * rs];
+      else
+        for (int i = 0; i < mr; i++)
+          packed[i] = matrixLoad(A->data, col + i * rs, A->dtype, A->scale);
+      for (int i = mr; i < GEMM_MR; i++)
+        packed[i] = 0;
+      packed += GEMM_MR;
+    }
+  }
+}
+
+// Pack the kc x nc panel of B at (p0, j0) into column micro-panels: panel[k][0..NR)
+static void gemmPackPanelB(int kc, int nc, const GemmOperand *B, size_t p0, size_t j0, MATRIX_TYPE *packed)
+{
+  size_t rs = B->rs, cs = B->cs;
+  // Transposed B (columns unit-stride): walk each source column along k
+  if (B->dtype == MATRIX_F32 && rs == 1 && cs != 1)
+  {
+    for (int jr = 0; jr < nc; jr += GEMM_NR)
+    {
+      int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+      MATRIX_TYPE *panel = packed + (size_t)jr * kc;
+      for (int j = 0; j < GEMM_NR; j++)
+      {
+        const MATRIX_TYPE *src = (const MATRIX_TYPE *)B->data + p0 + (j0 + jr + j) * cs;
+        if (j < nr)
+          for (int p = 0; p < kc; p++)
+            panel[(size_t)p * GEMM_NR + j] = src[p];
+        else
+          for (int p = 0; p < kc; p++)
+            panel[(size_t)p * GEMM_NR + j] = 0;
+      }
+    }
+    return;
+  }
+
+  for (int jr = 0; jr < nc; jr += GEMM_NR)
+  {
+    int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+    for (int p = 0; p < kc; p++)
+    {
+      size_t row = (p0 + p) * rs + (j0 + jr) * cs;
+      if (B->dtype != MATRIX_F32)
+        for (int j = 0; j < nr; j++)
+          packed[j] = matrixLoad(B->data, row + j * cs, B->dtype, B->scale);
+      else if (cs == 1)
+        for (int j = 0; j < nr; j++)
+          packed[j] = ((const MATRIX_TYPE *)B->data)[row + j];
+      else
+        for (int j = 0; j < nr; j++)
+          packed[j] = ((const MATRIX_TYPE *)B->data)[row + j * cs];
+      for (int j = nr; j < GEMM_NR; j++)
+        packed[j] = 0;
+      packed += GEMM_NR;
+    }
+  }
+}
+
+// Int8 packing for gemmMicroI8: int16 pairs along k, zero-padded to an
+// even kc and to whole panels
+static void gemmPackBlockAI8(int mc, int kc, const GemmOperand *A, size_t i0, size_t p0, int16_t *packed)
+{
+  const int8_t *q = (const int8_t *)A->data;
+  size_t rs = A->rs, cs = A->cs;
+  for (int ir = 0; ir < mc; ir += GEMM_I8_MR)
+  {
+    int mr = mc - ir < GEMM_I8_MR ? mc - ir : GEMM_I8_MR;
+    for (int p = 0; p < kc; p += 2)
+    {
+      for (int i = 0; i < GEMM_I8_MR; i++)
+      {
+        size_t at = (i0 + ir + i) * rs + (p0 + p) * cs;
+        packed[2 * i] = i < mr ? q[at] : 0;
+        packed[2 * i + 1] = i < mr && p + 1 < kc ? q[at + cs] : 0;
+      }
+      packed += 2 * GEMM_I8_MR;
+    }
+  }
+}
+
+static void gemmPackPanelBI8(int kc, int nc, const GemmOperand *B, size_t p0, size_t j0, int16_t *packed)
+{
+  const int8_t *q = (const int8_t *)B->data;
+  size_t rs = B->rs, cs = B->cs;
+  for (int jr = 0; jr < nc; jr += GEMM_NR)
+  {
+    int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+    for (int p = 0; p < kc; p += 2)
+    {
+      const int8_t *row = q + (p0 + p) * rs + (j0 + jr) * cs;
+      for (int j = 0; j < GEMM_NR; j++)
+      {
+        packed[2 * j] = j < nr ? row[j * cs] : 0;
+        packed[2 * j + 1] = j < nr && p + 1 < kc ? row[j * cs + rs] : 0;
+      }
+      packed += 2 * GEMM_NR;
+    }
+  }
+}
+
+typedef struct GemmTask
+{
+  int m, n, k;
+  GemmOperand A;
+  GemmOperand B;
+  MATRIX_TYPE *C;
+  int ldc;
+  int tileRows; // multiple of GEMM_MC
+  int tileCols; // multiple of GEMM_NR, at most GEMM_NC
+  int colTiles;
+} GemmTask;
+
+// One output tile C[i0:i1, j0:j1], run through the full blocked loop nest.
+// Two int8 operands are packed as int16 pairs into the same scratch
+// buffers and go through the int8 micro-kernel.
+static void gemmTaskRun(void *ctx, int task, int worker)
+{
+  const GemmTask *t = (const GemmTask *)ctx;
+  GemmScratch *scratch = &gemmScratch[worker];
+  void (*gemmMicro)(int, const MATRIX_TYPE *, const MATRIX_TYPE *, MATRIX_TYPE *, int, int, int, int) =
+      matrixKernels()->gemmMicro;
+  void (*gemmMicroI8)(int, const int16_t *, const int16_t *, float, MATRIX_TYPE *, int, int, int, int) =
+      matrixKernels()->gemmMicroI8;
+  int int8 = t->A.dtype == MATRIX_I8 && t->B.dtype == MATRIX_I8;
+  int16_t *packA16 = (int16_t *)scratch->packA, *packB16 = (int16_t *)scratch->packB;
+  float scale = t->A.scale * t->B.scale;
+
+  int i0 = task / t->colTiles * t->tileRows;
+  int j0 = task % t->colTiles * t->tileCols;
+  int i1 = i0 + t->tileRows < t->m ? i0 + t->tileRows : t->m;
+  int j1 = j0 + t->tileCols < t->n ? j0 + t->tileCols : t->n;
+  int k = t->k;
+  int ldc = t->ldc;
+
+  for (int jc = j0; jc < j1; jc += GEMM_NC)
+  {
+    int nc = j1 - jc < GEMM_NC ? j1 - jc : GEMM_NC;
+    for (int pc = 0; pc < k; pc += GEMM_KC)
+    {
+      int kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+      int kc2 = (kc + 1) / 2;
+      if (int8)
+        gemmPackPanelBI8(kc, nc, &t->B, (size_t)pc, (size_t)jc, packB16);
+      else
+        gemmPackPanelB(kc, nc, &t->B, (size_t)pc, (size_t)jc, scratch->packB);
+
+      for (int ic = i0; ic < i1; ic += GEMM_MC)
+      {
+        int mc = i1 - ic < GEMM_MC ? i1 - ic : GEMM_MC;
+        if (int8)
+          gemmPackBlockAI8(mc, kc, &t->A, (size_t)ic, (size_t)pc, packA16);
+        else
+          gemmPackBlockA(mc, kc, &t->A, (size_t)ic, (size_t)pc, scratch->packA);
+
+        for (int jr = 0; jr < nc; jr += GEMM_NR)
+        {
+          int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+          if (int8)
+          {
+            for (int ir = 0; ir < mc; ir += GEMM_I8_MR)
+            {
+              int mr = mc - ir < GEMM_I8_MR ? mc - ir : GEMM_I8_MR;
+              gemmMicroI8(kc2, packA16 + 2 * ir * kc2, packB16 + 2 * jr * kc2, scale,
+                          t->C + (size_t)(ic + ir) * ldc + jc + jr, ldc, mr, nr, pc > 0);
+            }
+            continue;
+          }
+          for (int ir = 0; ir < mc; ir += GEMM_MR)
+          {
+            int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+            gemmMicro(kc, scratch->packA + ir * kc, scratch->packB + jr * kc,
+                      t->C + (size_t)(ic + ir) * ldc + jc + jr, ldc, mr, nr, pc > 0);
+          }
+        }
+      }
+    }
+  }
+}
+
+// C[m x n] = A[m x k] * B[k x n]. A and B take any strides and dtype
+// (packing absorbs them); C is row-major with leading dimension ldc.
+// Single-threaded it is one tile; otherwise C is cut into MC-row by
+// NR-multiple-column tiles until there are a few tiles per worker.
+static int gemmBlocked(int m, int n, int k, GemmOperand A, GemmOperand B, MATRIX_TYPE *C, int ldc)
+{
+  if (m == 0 || n == 0)
+    return 0;
+
+  if (k == 0)
+  {
+    for (int i = 0; i < m; i++)
+      for (int j = 0; j < n; j++)
+        C[(size_t)i * ldc + j] = 0;
+    return 0;
+  }
+
+  int workers = matrixWorkersFor((size_t)m * n * k);
+  if (!gemmReserveBuffers(workers))
+  {
+    fprintf(stderr, "Error: Memory allocation failed for GEMM packing buffers.\n");
+    return -1;
+  }
+
+  GemmTask task = {m, n, k, A, B, C, ldc, m, n, 1};
+  if (workers > 1)
+  {
+    int rowTiles = (m + GEMM_MC - 1) / GEMM_MC;
+    task.tileRows = GEMM_MC;
+    task.tileCols = (n + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+    if (task.tileCols > GEMM_NC)
+      task.tileCols = GEMM_NC;
+    while (rowTiles * ((n + task.tileCols - 1) / task.tileCols) < 4 * workers && task.tileCols > 4 * GEMM_NR)
+      task.tileCols = (task.tileCols / 2 + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+  }
+  task.colTiles = (n + task.tileCols - 1) / task.tileCols;
+  int rowTiles = (m + task.tileRows - 1) / task.tileRows;
+
+  matrixParallelFor(rowTiles * task.colTiles, gemmTaskRun, &task, (size_t)m * n * k);
+  return 0;
+}
+
+// result = A * B into caller-provided storage (must not alias A or B).
+// result is f32; A and B may be any dtype (two int8 operands take the int8
+// path with int32 accumulation, anything else is widened to float while
+// packing).
+int multiplyMatricesInto(const Matrix_t *A, const Matrix_t *B, Matrix_t *result)
+{
+  if (!A || !B || !A->data || !B->data)
+  {
+    fprintf(stderr, "Error: Invalid matrix pointer.\n");
+    return -1;
+  }
+
+  if (A->cols != B->rows)
+  {
+    fprintf(stderr, "Error: Number of columns in A must equal number of rows in B for multiplication.\n");
+    return -1;
+  }
+
+  if (!result || !result->data || result->rows != A->rows || result->cols != B->cols)
+  {
+    fprintf(stderr, "Error: Result matrix must be %dx%d for multiplication.\n", A->rows, B->cols);
+    return -1;
+  }
+
+  if (matrixOverlaps(result, A) || matrixOverlaps(result, B))
+  {
+    fprintf(stderr, "Error: Result matrix must not alias an operand of the multiplication.\n");
+    return -1;
+  }
+
+  if (matrixRequireF32(result, "Multiplication result") || matrixRequireWritable(result, "Multiplication"))
+    return -1;
+  // A column-major result is filled as C^T = B^T * A^T
+  if (result->colStride != 1 && result->cols > 1)
+    return gemmBlocked(B->cols, A->rows, A->cols,
+                       gemmOperand(B->data, B->colStride, B->rowStride, B->dtype, B->scale),
+                       gemmOperand(A->data, A->colStride, A->rowStride, A->dtype, A->scale),
+                       result->data, result->colStride);
+  return gemmBlocked(A->rows, B->cols, A->cols,
+                     gemmOperand(A->data, A->rowStride, A->colStride, A->dtype, A->scale),
+                     gemmOperand(B->data, B->rowStride, B->colStride, B->dtype, B->scale),
+                     result->data, result->rowStride);
+}
+
+Matrix_t *multiplyMatrices(const Matrix_t *A, const Matrix_t *B)
+{
+  if (A->cols != B->rows)
+  {
+    fprintf(stderr, "Error: Number of columns in A must equal number of rows in B for multiplication.\n");
+    return NULL;
+  }
+
+  Matrix_t *result = newMatrix(A->rows, B->cols);
+  if (!result)
+  {
+    return NULL;
+  }
+
+  if (multiplyMatricesInto(A, B, result) != 0)
+  {
+    deleteMatrix(result);
+    return NULL;
+  }
+  return result;
+}
+
+// result = op(A) * op(B), where op(X) is X^T when its flag is nonzero.
+// Nothing is copied: a transposed operand is a transposed view, which the
+// packing routines read along whichever stride is unit.
+int multiplyMatricesTransInto(const Matrix_t *A, int transA, const Matrix_t *B, int transB, Matrix_t *result)
+{
+  if (!A || !B)
+    return multiplyMatricesInto(A, B, result);
+  Matrix_t a = transA ? matrixTransposeView(A) : *A;
+  Matrix_t b = transB ? matrixTransposeView(B) : *B;
+  return multiplyMatricesInto(&a, &b, result);
+}
+
+Matrix_t *multiplyMatricesTrans(const Matrix_t *A, int transA, const Matrix_t *B, int transB)
+{
+  Matrix_t a = transA ? matrixTransposeView(A) : *A;
+  Matrix_t b = transB ? matrixTransposeView(B) : *B;
+  return multiplyMatrices(&a, &b);
+}
+
+// Batched small GEMM
+// C[b] = A[b] * B[b] for count matrices of one fixed shape stored back to
+// back, i.e. A is (count * M) x K, B is (count * K) x N and C is
+// (count * M) x N. BATCH_GEMM_KERNEL(M, K, N) stamps out a kernel per shape:
+// with the dimensions known at compile time the per-matrix loops unroll
+// completely and the compiler vectorizes across the batch (one matrix per
+// lane), with no setup, checks or allocation per product. Each shape is
+// compiled for every kernel ISA and picked with the active kernel set.
+#define BATCH_GEMM_MIN_PER_TASK 4096
+
+typedef void (*BatchGemmFn)(const MATRIX_TYPE *A, const MATRIX_TYPE *B, MATRIX_TYPE *C, size_t count);
+
+#define BATCH_GEMM_BODY(M, K, N)                                   \
+  for (size_t b = 0; b < count; b++)                               \
+  {                                                                \
+    const MATRIX_TYPE *a = A + b * ((M) * (K));                    \
+    const MATRIX_TYPE *x = B + b * ((K) * (N));                    \
+    MATRIX_TYPE *c = C + b * ((M) * (N));                          \
+    for (int i = 0; i < (M); i++)                                  \
+      for (int j = 0; j < (N); j++)                                \
+      {                                                            \
+        MATRIX_TYPE acc = 0;                                       \
+        for (int p = 0; p < (K); p++)                              \
+          acc += a[i * (K) + p] * x[p * (N) + j];                  \
+        c[i * (N) + j] = acc;                                      \
+      }                                                            \
+  }
+
+#define BATCH_GEMM_VARIANT(M, K, N, SUFFIX, ATTR)                                               \
+  ATTR static void multiplyBatch_##M##x##K##x##N##_##SUFFIX(const MATRIX_TYPE *restrict A,     \
+                                                             const MATRIX_TYPE *restrict B,     \
+                                                             MATRIX_TYPE *restrict C, size_t count) \
+  {                                                                                             \
+    BATCH_GEMM_BODY(M, K, N)                                                                    \
+  }
+
+#ifdef MATRIX_X86_KERNELS
+#define BATCH_GEMM_KERNEL(M, K, N)                                                  \
+  BATCH_GEMM_VARIANT(M, K, N, scalar, )                                             \
+  BATCH_GEMM_VARIANT(M, K, N, avx2, __attribute__((target("avx2,fma"))))            \
+  BATCH_GEMM_VARIANT(M, K, N, avx512, __attribute__((target("avx512f"))))
+#define BATCH_GEMM_ENTRY(M, K, N)                                                                        \
+  {M, K, N, {multiplyBatch_##M##x##K##x##N##_scalar, multiplyBatch_##M##x##K##x##N##_scalar,              \
+             multiplyBatch_##M##x##K##x##N##_avx2, multiplyBatch_##M##x##K##x##N##_avx512}}
+#else
+#define BATCH_GEMM_KERNEL(M, K, N) BATCH_GEMM_VARIANT(M, K, N, scalar, )
+#define BATCH_GEMM_ENTRY(M, K, N) {M, K, N, {multiplyBatch_##M##x##K##x##N##_scalar}}
+#endif
+
+BATCH_GEMM_KERNEL(2, 2, 2)
+BATCH_GEMM_KERNEL(2, 3, 2)
+BATCH_GEMM_KERNEL(3, 2, 3)
+BATCH_GEMM_KERNEL(3, 3, 3)
+BATCH_GEMM_KERNEL(4, 4, 4)
+
+typedef struct BatchGemmShape
+{
+  int m, k, n;
+  BatchGemmFn fn[MATRIX_ISA_AVX512 + 1]; // indexed by MatrixIsa
+} BatchGemmShape;
+
+static const BatchGemmShape batchGemmShapes[] = {
+    BATCH_GEMM_ENTRY(2, 2, 2),
+    BATCH_GEMM_ENTRY(2, 3, 2),
+    BATCH_GEMM_ENTRY(3, 2, 3),
+    BATCH_GEMM_ENTRY(3, 3, 3),
+    BATCH_GEMM_ENTRY(4, 4, 4),
+};
+
+typedef struct BatchGemmTask
+{
+  BatchGemmFn fn;
+  int m, k, n;
+  const Matrix_t *A;
+  const Matrix_t *B;
+  Matrix_t *C;
+  size_t count;
+  size_t chunk;
+} BatchGemmTask;
+
+// Any other shape or strided operands: runtime loop bounds and strides
+static void multiplyBatchGeneric(const BatchGemmTask *t, size_t begin, size_t end)
+{
+  int m = t->m, k = t->k, n = t->n;
+  for (size_t b = begin; b < end; b++)
+    for (int i = 0; i < m; i++)
+      for (int j = 0; j < n; j++)
+      {
+        MATRIX_TYPE acc = 0;
+        for (int p = 0; p < k; p++)
+          acc += MATRIX_AT(t->A, b * m + i, p) * MATRIX_AT(t->B, b * k + p, j);
+        MATRIX_AT(t->C, b * m + i, j) = acc;
+      }
+}
+
+static void batchGemmTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  const BatchGemmTask *t = (const BatchGemmTask *)ctx;
+  size_t begin = (size_t)task * t->chunk;
+  size_t end = begin + t->chunk < t->count ? begin + t->chunk : t->count;
+  if (t->fn)
+    t->fn(t->A->data + begin * t->m * t->k, t->B->data + begin * t->k * t->n,
+          t->C->data + begin * t->m * t->n, end - begin);
+  else
+    multiplyBatchGeneric(t, begin, end);
+}
+
+// count products of (rows/count) x K by K x N blocks stacked in A, B and C
+int multiplyMatricesBatched(const Matrix_t *A, const Matrix_t *B, Matrix_t *C, int count)
+{
+  if (!A || !B || !C || !A->data || !B->data || !C->data || count <= 0)
+  {
+    fprintf(stderr, "Error: Invalid batch.\n");
+    return -1;
+  }
+  if (matrixRequireF32(A, "Batched multiplication") || matrixRequireF32(B, "Batched multiplication") ||
+      matrixRequireF32(C, "Batched multiplication") || matrixRequireWritable(C, "Batched multiplication"))
+    return -1;
+
+  int m = A->rows / count, k = A->cols, n = B->cols;
+  if (A->rows != m * count || B->rows != k * count || C->rows != m * count || C->cols != n)
+  {
+    fprintf(stderr, "Error: Batch of %d needs A (%d*m)xK, B (%d*K)xN and C (%d*m)xN.\n", count, count, count, count);
+    return -1;
+  }
+
+  BatchGemmTask task = {NULL, m, k, n, A, B, C, (size_t)count, 0};
+  MatrixIsa isa = (MatrixIsa)(matrixKernels() - matrixKernelTable);
+  int contiguous = matrixIsContiguous(A) && matrixIsContiguous(B) && matrixIsContiguous(C);
+  for (size_t s = 0; contiguous && s < sizeof(batchGemmShapes) / sizeof(batchGemmShapes[0]); s++)
+    if (batchGemmShapes[s].m == m && batchGemmShapes[s].k == k && batchGemmShapes[s].n == n)
+      task.fn = batchGemmShapes[s].fn[isa];
+
+  size_t work = (size_t)count * m * n * k;
+  task.chunk = matrixChunkSize(task.count, matrixWorkersFor(work));
+  if (task.chunk < BATCH_GEMM_MIN_PER_TASK)
+    task.chunk = BATCH_GEMM_MIN_PER_TASK;
+  matrixParallelFor((int)((task.count + task.chunk - 1) / task.chunk), batchGemmTaskRun, &task, work);
+  return 0;
+}
+
+// Strassen-Winograd
+// 7 half-size products and 15 additions per level instead of 8 products,
+// recursing until the blocks are at most the crossover size and then
+// handing them to the blocked GEMM. The schedule is the two-temporary one
+// of Douglas et al. (1994): the quadrants of C double as storage for the
+// products, so each level needs only X and Y (h x h each) and the whole
+// recursion fits in 2/3 n^2 floats. That workspace, and the padded copies
+// used when n does not halve evenly, belong to the call, so concurrent
+// calls never share them; allocating O(n^2) per O(n^2.8) product is noise.
+#define STRASSEN_CROSSOVER 512 // measured: 256 is ~10% faster at 4096 but 3x less accurate
+
+static int strassenCrossover = STRASSEN_CROSSOVER;
+
+// Blocks at or below this size use the base kernel
+void matrixSetStrassenCrossover(int n)
+{
+  strassenCrossover = n > 16 ? n : 16;
+}
+
+// Z = X + Y or Z = X - Y on n x n strided blocks (Z may alias X or Y)
+static void strassenAdd(int n, const MATRIX_TYPE *X, int ldx, const MATRIX_TYPE *Y, int ldy,
+                        MATRIX_TYPE *Z, int ldz)
+{
+  for (int i = 0; i < n; i++)
+    matrixKernels()->add(X + (size_t)i * ldx, Y + (size_t)i * ldy, Z + (size_t)i * ldz, (size_t)n);
+}
+
+static void strassenSub(int n, const MATRIX_TYPE *X, int ldx, const MATRIX_TYPE *Y, int ldy,
+                        MATRIX_TYPE *Z, int ldz)
+{
+  for (int i = 0; i < n; i++)
+  {
+    const MATRIX_TYPE *x = X + (size_t)i * ldx;
+    const MATRIX_TYPE *y = Y + (size_t)i * ldy;
+    MATRIX_TYPE *z = Z + (size_t)i * ldz;
+    for (int j = 0; j < n; j++)
+      z[j] = x[j] - y[j];
+  }
+}
+
+// C = A * B on n x n blocks; n halves evenly down to the crossover
+static int strassenRecurse(int n, const MATRIX_TYPE *A, int lda, const MATRIX_TYPE *B, int ldb,
+                           MATRIX_TYPE *C, int ldc, MATRIX_TYPE *ws)
+{
+  if (n <= strassenCrossover || n % 2)
+    return gemmBlocked(n, n, n, gemmOperand(A, lda, 1, MATRIX_F32, 1.0f), gemmOperand(B, ldb, 1, MATRIX_F32, 1.0f), C, ldc);
+
+  int h = n / 2;
+  const MATRIX_TYPE *A11 = A, *A12 = A + h, *A21 = A + (size_t)h * lda, *A22 = A21 + h;
+  const MATRIX_TYPE *B11 = B, *B12 = B + h, *B21 = B + (size_t)h * ldb, *B22 = B21 + h;
+  MATRIX_TYPE *C11 = C, *C12 = C + h, *C21 = C + (size_t)h * ldc, *C22 = C21 + h;
+  MATRIX_TYPE *X = ws, *Y = ws + (size_t)h * h, *next = ws + 2 * (size_t)h * h;
+
+  int status = 0;
+  strassenSub(h, A11, lda, A21, lda, X, h); // S3
+  strassenSub(h, B22, ldb, B12, ldb, Y, h); // T3
+  status |= strassenRecurse(h, X, h, Y, h, C21, ldc, next); // P7
+  strassenAdd(h, A21, lda, A22, lda, X, h); // S1
+  strassenSub(h, B12, ldb, B11, ldb, Y, h); // T1
+  status |= strassenRecurse(h, X, h, Y, h, C22, ldc, next); // P5
+  strassenSub(h, X, h, A11, lda, X, h);     // S2
+  strassenSub(h, B22, ldb, Y, h, Y, h);     // T2
+  status |= strassenRecurse(h, X, h, Y, h, C12, ldc, next); // P6
+  strassenSub(h, A12, lda, X, h, X, h);     // S4
+  status |= strassenRecurse(h, X, h, B22, ldb, C11, ldc, next); // P3
+  status |= strassenRecurse(h, A11, lda, B11, ldb, X, h, next); // P1
+
+  strassenAdd(h, X, h, C12, ldc, C12, ldc);     // U2 = P1 + P6
+  strassenAdd(h, C12, ldc, C21, ldc, C21, ldc); // U3 = U2 + P7
+  strassenAdd(h, C12, ldc, C22, ldc, C12, ldc); // U4 = U2 + P5
+  strassenAdd(h, C21, ldc, C22, ldc, C22, ldc); // C22 = U3 + P5
+  strassenAdd(h, C12, ldc, C11, ldc, C12, ldc); // C12 = U4 + P3
+
+  strassenSub(h, Y, h, B21, ldb, Y, h);         // T4
+  status |= strassenRecurse(h, A22, lda, Y, h, C11, ldc, next); // P4
+  strassenSub(h, C21, ldc, C11, ldc, C21, ldc); // C21 = U3 - P4
+  status |= strassenRecurse(h, A12, lda, B21, ldb, C11, ldc, next); // P2
+  strassenAdd(h, X, h, C11, ldc, C11, ldc);     // C11 = P1 + P2
+  return status;
+}
+
+// Square f32 operands only; everything else (and anything at or below the
+// crossover) goes to multiplyMatricesInto
+int multiplyMatricesStrassenInto(const Matrix_t *A, const Matrix_t *B, Matrix_t *result)
+{
+  if (!A || !B || !A->data || !B->data)
+  {
+    fprintf(stderr, "Error: Invalid matrix pointer.\n");
+    return -1;
+  }
+
+  int n = A->rows;
+  if (A->cols != n || B->rows != n || B->cols != n || n <= strassenCrossover ||
+      A->dtype != MATRIX_F32 || B->dtype != MATRIX_F32)
+    return multiplyMatricesInto(A, B, result);
+
+  if (!result || !result->data || result->rows != n || result->cols != n)
+  {
+    fprintf(stderr, "Error: Result matrix must be %dx%d for multiplication.\n", n, n);
+    return -1;
+  }
+
+  if (matrixRequireF32(result, "Multiplication result") || matrixRequireWritable(result, "Multiplication"))
+    return -1;
+
+  if (matrixOverlaps(result, A) || matrixOverlaps(result, B))
+  {
+    fprintf(stderr, "Error: Result matrix must not alias an operand of the multiplication.\n");
+    return -1;
+  }
+
+  // Pad n up to leaf * 2^levels so that every level halves evenly
+  int levels = 0, leaf = n;
+  while (leaf > strassenCrossover)
+  {
+    leaf = (leaf + 1) / 2;
+    levels++;
+  }
+  int padded = leaf << levels;
+
+  size_t scratch = 0;
+  for (int size = padded; size > leaf; size /= 2)
+    scratch += 2 * (size_t)(size / 2) * (size / 2);
+  // Row-major operands are used in place; anything else goes through copies
+  int direct = padded == n && A->colStride == 1 && B->colStride == 1 && result->colStride == 1;
+  if (!direct)
+    scratch += 3 * (size_t)padded * padded;
+
+  MATRIX_TYPE *ws = (MATRIX_TYPE *)malloc(sizeof(MATRIX_TYPE) * scratch);
+  if (!ws)
+  {
+    fprintf(stderr, "Error: Memory allocation failed for Strassen workspace.\n");
+    return -1;
+  }
+
+  if (direct)
+  {
+    int status = strassenRecurse(n, A->data, A->rowStride, B->data, B->rowStride, result->data, result->rowStride, ws);
+    free(ws);
+    return status;
+  }
+
+  MATRIX_TYPE *Ap = ws;
+  MATRIX_TYPE *Bp = Ap + (size_t)padded * padded;
+  MATRIX_TYPE *Cp = Bp + (size_t)padded * padded;
+  memset(Ap, 0, sizeof(MATRIX_TYPE) * 2 * (size_t)padded * padded);
+  Matrix_t Av = matrixWrap(Ap, n, n, padded), Bv = matrixWrap(Bp, n, n, padded), Cv = matrixWrap(Cp, n, n, padded);
+  copyMatrixInto(A, &Av);
+  copyMatrixInto(B, &Bv);
+
+  int status = strassenRecurse(padded, Ap, padded, Bp, padded, Cp, padded, Cp + (size_t)padded * padded);
+  copyMatrixInto(&Cv, result);
+  free(ws);
+  return status;
+}
+
+Matrix_t *multiplyMatricesStrassen(const Matrix_t *A, const Matrix_t *B)
+{
+  if (A->cols != B->rows)
+  {
+    fprintf(stderr, "Error: Number of columns in A must equal number of rows in B for multiplication.\n");
+    return NULL;
+  }
+
+  Matrix_t *result = newMatrix(A->rows, B->cols);
+  if (!result)
+  {
+    return NULL;
+  }
+
+  if (multiplyMatricesStrassenInto(A, B, result) != 0)
+  {
+    deleteMatrix(result);
+    return NULL;
+  }
+  return result;
+}
+
+// Sparse matrices
+// CSR keeps the nonzeros of each row together: entries ptr[i] .. ptr[i+1]
+// hold the column numbers (idx, ascending) and values of row i. CSC is the
+// same layout over columns, i.e. the CSR form of the transpose. Storage is
+// (outer + 1) offsets plus nnz (index, value) pairs, and every operation
+// below visits each stored entry a fixed number of times, so time and memory
+// follow nnz instead of rows * cols. Parallel work is cut into row blocks of
+// about equal nnz, not equal row counts, so a few dense rows do not stall a
+// single worker.
+typedef enum SparseFormat
+{
+  SPARSE_CSR,
+  SPARSE_CSC
+} SparseFormat;
+
+typedef struct SparseMatrix_t
+{
+  int rows;
+  int cols;
+  SparseFormat format;
+  size_t nnz;
+  size_t *ptr; // outer + 1 offsets; outer is rows (CSR) or cols (CSC)
+  int *idx;    // inner index of each entry: column (CSR) or row (CSC)
+  MATRIX_TYPE *values;
+} SparseMatrix_t;
+
+static int sparseOuter(const SparseMatrix_t *s)
+{
+  return s->format == SPARSE_CSR ? s->rows : s->cols;
+}
+
+static int sparseInner(const SparseMatrix_t *s)
+{
+  return s->format == SPARSE_CSR ? s->cols : s->rows;
+}
+
+// Resize the entry arrays to nnz; ptr is left to the caller
+static int sparseReserve(SparseMatrix_t *s, size_t nnz)
+{
+  int *idx = (int *)realloc(s->idx, sizeof(int) * (nnz ? nnz : 1));
+  if (idx)
+    s->idx = idx;
+  MATRIX_TYPE *values = (MATRIX_TYPE *)realloc(s->values, sizeof(MATRIX_TYPE) * (nnz ? nnz : 1));
+  if (values)
+    s->values = values;
+  if (!idx || !values)
+  {
+    fprintf(stderr, "Error: Memory allocation failed for %zu sparse entries.\n", nnz);
+    return -1;
+  }
+  s->nnz = nnz;
+  return 0;
+}
+
+void deleteSparseMatrix(SparseMatrix_t *s)
+{
+  if (!s)
+    return;
+  free(s->ptr);
+  free(s->idx);
+  free(s->values);
+  free(s);
+}
+
+// Room for nnz entries with every row (CSR) or column (CSC) empty
+SparseMatrix_t *newSparseMatrix(int rows, int cols, size_t nnz, SparseFormat format)
+{
+  SparseMatrix_t *s = (SparseMatrix_t *)calloc(1, sizeof(*s));
+  if (!s)
+  {
+    fprintf(stderr, "Error: Memory allocation failed for sparse matrix struct.\n");
+    return NULL;
+  }
+
+  s->rows = rows;
+  s->cols = cols;
+  s->format = format;
+  s->ptr = (size_t *)calloc((size_t)sparseOuter(s) + 1, sizeof(size_t));
+  if (!s->ptr)
+    fprintf(stderr, "Error: Memory allocation failed for %dx%d sparse matrix.\n", rows, cols);
+  if (!s->ptr || sparseReserve(s, nnz) != 0)
+  {
+    deleteSparseMatrix(s);
+    return NULL;
+  }
+  s->nnz = 0;
+  return s;
+}
+
+#define SPARSE_TASKS_PER_WORKER 4
+
+// Split [0, outer) into blocks of about equal work, counting one unit per
+// row plus one per stored entry of each ptr array given (ptrB may be NULL).
+// bounds needs room for MATRIX_MAX_THREADS * SPARSE_TASKS_PER_WORKER + 1.
+static int sparseSplit(const size_t *ptrA, const size_t *ptrB, int outer, int workers, int *bounds)
+{
+  int numTasks = workers > 1 ? workers * SPARSE_TASKS_PER_WORKER : 1;
+  if (numTasks > outer)
+    numTasks = outer > 1 ? outer : 1;
+
+  size_t total = ptrA[outer] + (ptrB ? ptrB[outer] : 0) + (size_t)outer;
+  bounds[0] = 0;
+  for (int t = 1; t < numTasks; t++)
+  {
+    size_t target = (size_t)((double)total * t / numTasks);
+    int lo = bounds[t - 1], hi = outer;
+    while (lo < hi)
+    {
+      int mid = lo + (hi - lo) / 2;
+      if (ptrA[mid] + (ptrB ? ptrB[mid] : 0) + (size_t)mid < target)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    bounds[t] = lo;
+  }
+  bounds[numTasks] = outer;
+  return numTasks;
+}
+
+typedef struct SparseTask
+{
+  const SparseMatrix_t *A, *B;
+  SparseMatrix_t *out;
+  const Matrix_t *X; // dense operand, or the source of a conversion
+  Matrix_t *Y;       // dense result
+  int bounds[MATRIX_MAX_THREADS * SPARSE_TASKS_PER_WORKER + 1];
+} SparseTask;
+
+// Dense to sparse: count the nonzeros of each row, then fill
+static void sparseCountTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  SparseTask *t = (SparseTask *)ctx;
+  const Matrix_t *X = t->X;
+  for (int i = t->bounds[task]; i < t->bounds[task + 1]; i++)
+  {
+    size_t count = 0;
+    for (int j = 0; j < X->cols; j++)
+      count += MATRIX_AT(X, i, j) != 0.0f;
+    t->out->ptr[i + 1] = count;
+  }
+}
+
+static void sparseFillTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  SparseTask *t = (SparseTask *)ctx;
+  const Matrix_t *X = t->X;
+  SparseMatrix_t *s = t->out;
+  for (int i = t->bounds[task]; i < t->bounds[task + 1]; i++)
+  {
+    size_t e = s->ptr[i];
+    for (int j = 0; j < X->cols; j++)
+    {
+      MATRIX_TYPE v = MATRIX_AT(X, i, j);
+      if (v != 0.0f)
+      {
+        s->idx[e] = j;
+        s->values[e++] = v;
+      }
+    }
+  }
+}
+
+// Split a dense pass over rows evenly
+static int sparseDenseSplit(int rows, size_t work, int *bounds)
+{
+  int workers = matrixWorkersFor(work);
+  int numTasks = workers > 1 ? workers * SPARSE_TASKS_PER_WORKER : 1;
+  if (numTasks > rows)
+    numTasks = rows > 1 ? rows : 1;
+  for (int t = 0; t <= numTasks; t++)
+    bounds[t] = (int)((long long)rows * t / numTasks);
+  return numTasks;
+}
+
+// Transpose the storage order: CSR <-> CSC with the same logical matrix.
+// A counting sort over the inner index, so the result stays sorted.
+SparseMatrix_t *convertSparse(const SparseMatrix_t *s, SparseFormat format)
+{
+  SparseMatrix_t *out = newSparseMatrix(s->rows, s->cols, s->nnz, format);
+  if (!out)
+    return NULL;
+  out->nnz = s->nnz;
+  if (format == s->format)
+  {
+    memcpy(out->ptr, s->ptr, sizeof(size_t) * ((size_t)sparseOuter(s) + 1));
+    memcpy(out->idx, s->idx, sizeof(int) * s->nnz);
+    memcpy(out->values, s->values, sizeof(MATRIX_TYPE) * s->nnz);
+    return out;
+  }
+
+  int outer = sparseOuter(s), inner = sparseInner(s);
+  for (size_t e = 0; e < s->nnz; e++)
+    out->ptr[s->idx[e] + 1]++;
+  for (int j = 0; j < inner; j++)
+    out->ptr[j + 1] += out->ptr[j];
+
+  size_t *next = (size_t *)malloc(sizeof(size_t) * (inner ? inner : 1));
+  if (!next)
+  {
+    fprintf(stderr, "Error: Memory allocation failed for sparse conversion.\n");
+    deleteSparseMatrix(out);
+    return NULL;
+  }
+  memcpy(next, out->ptr, sizeof(size_t) * inner);
+  for (int i = 0; i < outer; i++)
+    for (size_t e = s->ptr[i]; e < s->ptr[i + 1]; e++)
+    {
+      size_t slot = next[s->idx[e]]++;
+      out->idx[slot] = i;
+      out->values[slot] = s->values[e];
+    }
+  free(next);
+  return out;
+}
+
+// Exact zeros are dropped; any f32 matrix or view is accepted
+SparseMatrix_t *matrixToSparse(const Matrix_t *matrix, SparseFormat format)
+{
+  if (!matrix || !matrix->data)
+  {
+    fprintf(stderr, "Error: Cannot convert a NULL matrix to sparse.\n");
+    return NULL;
+  }
+  if (matrixRequireF32(matrix, "Sparse conversion"))
+    return NULL;
+
+  // Scan along unit stride and fix up the format afterwards if needed
+  SparseFormat natural = matrix->colStride == 1 || matrix->rowStride != 1 ? SPARSE_CSR : SPARSE_CSC;
+  Matrix_t src = natural == SPARSE_CSR ? *matrix : matrixTransposeView(matrix);
+  SparseMatrix_t *s = newSparseMatrix(matrix->rows, matrix->cols, 0, natural);
+  if (!s)
+    return NULL;
+
+  SparseTask task;
+  task.X = &src;
+  task.out = s;
+  size_t work = (size_t)src.rows * src.cols;
+  int numTasks = sparseDenseSplit(src.rows, work, task.bounds);
+  matrixParallelFor(numTasks, sparseCountTaskRun, &task, work);
+  for (int i = 0; i < src.rows; i++)
+    s->ptr[i + 1] += s->ptr[i];
+  if (sparseReserve(s, s->ptr[src.rows]) != 0)
+  {
+    deleteSparseMatrix(s);
+    return NULL;
+  }
+  matrixParallelFor(numTasks, sparseFillTaskRun, &task, work);
+
+  if (natural == format)
+    return s;
+  SparseMatrix_t *converted = convertSparse(s, format);
+  deleteSparseMatrix(s);
+  return converted;
+}
+
+static void sparseScatterTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  SparseTask *t = (SparseTask *)ctx;
+  const SparseMatrix_t *s = t->A;
+  Matrix_t *Y = t->Y;
+  for (int i = t->bounds[task]; i < t->bounds[task + 1]; i++)
+  {
+    if (Y->colStride == 1)
+      memset(&MATRIX_AT(Y, i, 0), 0, sizeof(MATRIX_TYPE) * Y->cols);
+    else
+      for (int j = 0; j < Y->cols; j++)
+        MATRIX_AT(Y, i, j) = 0.0f;
+    for (size_t e = s->ptr[i]; e < s->ptr[i + 1]; e++)
+      MATRIX_AT(Y, i, s->idx[e]) = s->values[e];
+  }
+}
+
+// Expand into caller-provided f32 storage (a matrix or view of the same shape)
+int sparseToMatrixInto(const SparseMatrix_t *s, Matrix_t *result)
+{
+  if (!result || !result->data || result->rows != s->rows || result->cols != s->cols)
+  {
+    fprintf(stderr, "Error: Result matrix must be %dx%d for sparse expansion.\n", s->rows, s->cols);
+    return -1;
+  }
+  if (matrixRequireF32(result, "Sparse expansion") || matrixRequireWritable(result, "Sparse expansion"))
+    return -1;
+
+  Matrix_t dst = s->format == SPARSE_CSR ? *result : matrixTransposeView(result);
+  SparseTask task;
+  task.A = s;
+  task.Y = &dst;
+  size_t work = (size_t)s->rows * s->cols;
+  matrixParallelFor(sparseDenseSplit(dst.rows, work, task.bounds), sparseScatterTaskRun, &task, work);
+  return 0;
+}
+
+Matrix_t *sparseToMatrix(const SparseMatrix_t *s)
+{
+  Matrix_t *result = newMatrix(s->rows, s->cols);
+  if (!result)
+    return NULL;
+  sparseToMatrixInto(s, result);
+  return result;
+}
+
+// Sparse times dense. CSR: each task owns a block of rows of C and forms
+// C[i, :] = sum A[i, k] * B[k, :] with unit-stride row updates. CSC: each
+// task owns a block of columns of C and scatters column k of A times B[k, :]
+// into it, so no two tasks write the same element either way.
+static void sparseAxpy(MATRIX_TYPE a, const Matrix_t *B, int k, Matrix_t *C, int i, int j0, int j1)
+{
+  if (B->colStride == 1 && C->colStride == 1)
+  {
+    const MATRIX_TYPE *restrict b = &MATRIX_AT(B, k, 0);
+    MATRIX_TYPE *restrict c = &MATRIX_AT(C, i, 0);
+    for (int j = j0; j < j1; j++)
+      c[j] += a * b[j];
+  }
+  else
+    for (int j = j0; j < j1; j++)
+      MATRIX_AT(C, i, j) += a * MATRIX_AT(B, k, j);
+}
+
+static void sparseZeroRows(Matrix_t *C, int i0, int i1, int j0, int j1)
+{
+  for (int i = i0; i < i1; i++)
+    for (int j = j0; j < j1; j++)
+      MATRIX_AT(C, i, j) = 0.0f;
+}
+
+static void spmmCsrTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  SparseTask *t = (SparseTask *)ctx;
+  const SparseMatrix_t *A = t->A;
+  Matrix_t *C = t->Y;
+  int i0 = t->bounds[task], i1 = t->bounds[task + 1];
+
+  // One output column: a gather-dot per row
+  if (C->cols == 1)
+  {
+    for (int i = i0; i < i1; i++)
+    {
+      MATRIX_TYPE sum = 0.0f;
+      for (size_t e = A->ptr[i]; e < A->ptr[i + 1]; e++)
+        sum += A->values[e] * MATRIX_AT(t->X, A->idx[e], 0);
+      MATRIX_AT(C, i, 0) = sum;
+    }
+    return;
+  }
+
+  sparseZeroRows(C, i0, i1, 0, C->cols);
+  for (int i = i0; i < i1; i++)
+    for (size_t e = A->ptr[i]; e < A->ptr[i + 1]; e++)
+      sparseAxpy(A->values[e], t->X, A->idx[e], C, i, 0, C->cols);
+}
+
+static void spmmCscTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  SparseTask *t = (SparseTask *)ctx;
+  const SparseMatrix_t *A = t->A;
+  Matrix_t *C = t->Y;
+  int j0 = t->bounds[task], j1 = t->bounds[task + 1];
+  sparseZeroRows(C, 0, C->rows, j0, j1);
+  for (int k = 0; k < A->cols; k++)
+    for (size_t e = A->ptr[k]; e < A->ptr[k + 1]; e++)
+      sparseAxpy(A->values[e], t->X, k, C, A->idx[e], j0, j1);
+}
+
+// result = A * B for sparse A and dense B (any f32 matrix or view).
+// result must not alias B. CSR parallelizes over rows of A; CSC can only
+// split the columns of B, so prefer CSR (see convertSparse) for SpMV.
+int multiplySparseDenseInto(const SparseMatrix_t *A, const Matrix_t *B, Matrix_t *result)
+{
+  if (!B || !B->data || A->cols != B->rows)
+  {
+    fprintf(stderr, "Error: Number of columns in A must equal number of rows in B for multiplication.\n");
+    return -1;
+  }
+  if (!result || !result->data || result->rows != A->rows || result->cols != B->cols)
+  {
+    fprintf(stderr, "Error: Result matrix must be %dx%d for multiplication.\n", A->rows, B->cols);
+    return -1;
+  }
+  if (matrixRequireF32(B, "Sparse multiplication") || matrixRequireF32(result, "Sparse multiplication") ||
+      matrixRequireWritable(result, "Sparse multiplication"))
+    return -1;
+  if (matrixOverlaps(result, B))
+  {
+    fprintf(stderr, "Error: Result matrix must not alias an operand of the multiplication.\n");
+    return -1;
+  }
+
+  SparseTask task;
+  task.A = A;
+  task.X = B;
+  task.Y = result;
+  size_t work = (A->nnz + (size_t)A->rows) * (size_t)B->cols;
+  if (A->format == SPARSE_CSR)
+  {
+    int numTasks = sparseSplit(A->ptr, NULL, A->rows, matrixWorkersFor(work), task.bounds);
+    matrixParallelFor(numTasks, spmmCsrTaskRun, &task, work);
+    return 0;
+  }
+
+  // Column blocks of 16 keep each task's slice of a row in whole cache lines
+  int workers = matrixWorkersFor(work), n = B->cols;
+  int numTasks = workers > 1 ? workers : 1;
+  if (numTasks > (n + 15) / 16)
+    numTasks = n > 16 ? (n + 15) / 16 : 1;
+  for (int t = 0; t <= numTasks; t++)
+  {
+    int j = (int)((long long)n * t / numTasks);
+    task.bounds[t] = t == numTasks ? n : j & ~15;
+  }
+  matrixParallelFor(numTasks, spmmCscTaskRun, &task, work);
+  return 0;
+}
+
+Matrix_t *multiplySparseDense(const SparseMatrix_t *A, const Matrix_t *B)
+{
+  if (A->cols != B->rows)
+  {
+    fprintf(stderr, "Error: Number of columns in A must equal number of rows in B for multiplication.\n");
+    return NULL;
+  }
+
+  Matrix_t *result = newMatrix(A->rows, B->cols);
+  if (!result)
+    return NULL;
+  if (multiplySparseDenseInto(A, B, result) != 0)
+  {
+    deleteMatrix(result);
+    return NULL;
+  }
+  return result;
+}
+
+// y = A * x, with x a column vector of length A->cols (an A->cols x 1 matrix
+// or view, e.g. matrixColBlock(X, j, 1)) and y one of length A->rows
+int multiplySparseVectorInto(const SparseMatrix_t *A, const Matrix_t *x, Matrix_t *y)
+{
+  if (!x || x->cols != 1 || !y || y->cols != 1)
+  {
+    fprintf(stderr, "Error: Sparse matrix-vector multiplication needs column vectors.\n");
+    return -1;
+  }
+  return multiplySparseDenseInto(A, x, y);
+}
+
+// Sparse add: merge the sorted index lists of each row, counting first
+static void sparseAddCountTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  SparseTask *t = (SparseTask *)ctx;
+  const SparseMatrix_t *A = t->A, *B = t->B;
+  for (int i = t->bounds[task]; i < t->bounds[task + 1]; i++)
+  {
+    size_t a = A->ptr[i], aEnd = A->ptr[i + 1], b = B->ptr[i], bEnd = B->ptr[i + 1], count = 0;
+    while (a < aEnd && b < bEnd)
+    {
+      int ia = A->idx[a], ib = B->idx[b];
+      a += ia <= ib;
+      b += ib <= ia;
+      count++;
+    }
+    t->out->ptr[i + 1] = count + (aEnd - a) + (bEnd - b);
+  }
+}
+
+static void sparseAddFillTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  SparseTask *t = (SparseTask *)ctx;
+  const SparseMatrix_t *A = t->A, *B = t->B;
+  SparseMatrix_t *C = t->out;
+  for (int i = t->bounds[task]; i < t->bounds[task + 1]; i++)
+  {
+    size_t a = A->ptr[i], aEnd = A->ptr[i + 1], b = B->ptr[i], bEnd = B->ptr[i + 1], e = C->ptr[i];
+    while (a < aEnd || b < bEnd)
+    {
+      int ia = a < aEnd ? A->idx[a] : INT32_MAX, ib = b < bEnd ? B->idx[b] : INT32_MAX;
+      MATRIX_TYPE v = 0.0f;
+      if (ia <= ib)
+        v += A->values[a++];
+      if (ib <= ia)
+        v += B->values[b++];
+      C->idx[e] = ia < ib ? ia : ib;
+      C->values[e++] = v;
+    }
+  }
+}
+
+// A + B in A's format. The pattern is the union of both patterns: entries
+// that cancel are kept as stored zeros rather than paying a second pass.
+SparseMatrix_t *addSparse(const SparseMatrix_t *A, const SparseMatrix_t *B)
+{
+  if (A->rows != B->rows || A->cols != B->cols)
+  {
+    fprintf(stderr, "Error: Matrices must have the same dimensions for addition.\n");
+    return NULL;
+  }
+
+  SparseMatrix_t *converted = NULL;
+  if (B->format != A->format)
+  {
+    converted = convertSparse(B, A->format);
+    if (!converted)
+      return NULL;
+    B = converted;
+  }
+
+  int outer = sparseOuter(A);
+  SparseMatrix_t *C = newSparseMatrix(A->rows, A->cols, 0, A->format);
+  if (!C)
+  {
+    deleteSparseMatrix(converted);
+    return NULL;
+  }
+
+  SparseTask task;
+  task.A = A;
+  task.B = B;
+  task.out = C;
+  size_t work = A->nnz + B->nnz + (size_t)outer;
+  int numTasks = sparseSplit(A->ptr, B->ptr, outer, matrixWorkersFor(work), task.bounds);
+  matrixParallelFor(numTasks, sparseAddCountTaskRun, &task, work);
+  for (int i = 0; i < outer; i++)
+    C->ptr[i + 1] += C->ptr[i];
+  if (sparseReserve(C, C->ptr[outer]) != 0)
+  {
+    deleteSparseMatrix(C);
+    deleteSparseMatrix(converted);
+    return NULL;
+  }
+  matrixParallelFor(numTasks, sparseAddFillTaskRun, &task, work);
+  deleteSparseMatrix(converted);
+  return C;
+}
+
+// Reduction engine
+// A sum is cut into fixed blocks whose size depends only on n; blocks are
+// summed in parallel by the vector kernels and the block partials are
+// combined in index order. The answer is therefore bit-identical for every
+// thread count. The method trades speed for error growth (u = 2^-53,
+// S = sum of |x|):
+//   MATRIX_SUM_FAST      independent double accumulators, |err| <~ (n / lanes) u S
+//   MATRIX_SUM_PAIRWISE  pairwise tree over 512-element leaves, |err| <~ (512 + log2 n) u S
+//   MATRIX_SUM_KAHAN     compensated lanes and combine, |err| <~ 2 u S
+#define SUM_BLOCK ((size_t)1 << 16)
+#define SUM_MAX_BLOCKS 1024
+#define SUM_LEAF 512
+
+typedef enum MatrixSumMethod
+{
+  MATRIX_SUM_FAST,
+  MATRIX_SUM_PAIRWISE,
+  MATRIX_SUM_KAHAN
+} MatrixSumMethod;
+
+static MatrixSumMethod sumMethod = MATRIX_SUM_FAST;
+
+void matrixSetSumMethod(MatrixSumMethod method)
+{
+  sumMethod = method;
+}
+
+// Running combination of partial sums under the current method. Pairwise
+// keeps a binary counter of subtotals: level[b] holds the sum of 2^b leaves.
+typedef struct SumAccumulator
+{
+  MatrixSumMethod method;
+  double sum;
+  double comp;
+  double level[64];
+  uint64_t count;
+} SumAccumulator;
+
+static void sumAccInit(SumAccumulator *acc)
+{
+  acc->method = sumMethod;
+  acc->sum = acc->comp = 0.0;
+  acc->count = 0;
+}
+
+static void sumAccAdd(SumAccumulator *acc, double x)
+{
+  if (acc->method == MATRIX_SUM_KAHAN)
+  {
+    KAHAN_ADD(acc->sum, acc->comp, x);
+    return;
+  }
+  if (acc->method == MATRIX_SUM_FAST)
+  {
+    acc->sum += x;
+    return;
+  }
+
+  int b = 0;
+  for (uint64_t c = acc->count; c & 1; c >>= 1)
+    x = acc->level[b++] + x;
+  acc->level[b] = x;
+  acc->count++;
+}
+
+static double sumAccResult(const SumAccumulator *acc)
+{
+  if (acc->method != MATRIX_SUM_PAIRWISE)
+    return acc->sum - acc->comp;
+
+  double sum = 0.0;
+  for (int b = 0; b < 64; b++)
+    if (acc->count >> b & 1)
+      sum += acc->level[b];
+  return sum;
+}
+
+// Sum of a contiguous range under the current method and mode
+static double sumRange(const MATRIX_TYPE *a, size_t n)
+{
+  const MatrixKernels *k = matrixKernels();
+  if (sumMethod == MATRIX_SUM_KAHAN)
+    return k->sumKahan(a, n);
+
+  double (*leaf)(const MATRIX_TYPE *, size_t) = reproducibleMode ? k->sumReproducible : k->sum;
+  if (sumMethod == MATRIX_SUM_FAST || n <= SUM_LEAF)
+    return leaf(a, n);
+
+  SumAccumulator acc;
+  sumAccInit(&acc);
+  for (size_t i = 0; i < n; i += SUM_LEAF)
+    sumAccAdd(&acc, leaf(a + i, n - i < SUM_LEAF ? n - i : SUM_LEAF));
+  return sumAccResult(&acc);
+}
+
+// Block length for n elements: a multiple of SUM_LEAF, at most SUM_MAX_BLOCKS blocks
+static size_t sumBlockSize(size_t n)
+{
+  size_t block = SUM_BLOCK;
+  if (n > SUM_BLOCK * SUM_MAX_BLOCKS)
+    block = ((n + SUM_MAX_BLOCKS - 1) / SUM_MAX_BLOCKS + SUM_LEAF - 1) / SUM_LEAF * SUM_LEAF;
+  return block;
+}
+
+static double sumPartials(const double *partial, int count)
+{
+  SumAccumulator acc;
+  sumAccInit(&acc);
+  for (int b = 0; b < count; b++)
+    sumAccAdd(&acc, partial[b]);
+  return sumAccResult(&acc);
+}
+
+typedef struct SumTask
+{
+  const MATRIX_TYPE *data;
+  size_t n;
+  size_t block;
+  const Matrix_t *view; // strided matrix, block counts rows
+  double partial[SUM_MAX_BLOCKS];
+} SumTask;
+
+static void sumTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  SumTask *t = (SumTask *)ctx;
+  size_t begin = (size_t)task * t->block;
+  size_t len = begin + t->block < t->n ? t->block : t->n - begin;
+  if (!t->view)
+  {
+    t->partial[task] = sumRange(t->data + begin, len);
+    return;
+  }
+
+  SumAccumulator acc;
+  sumAccInit(&acc);
+  for (size_t i = begin; i < begin + len; i++)
+    sumAccAdd(&acc, sumRange(&MATRIX_AT(t->view, i, 0), (size_t)t->view->cols));
+  t->partial[task] = sumAccResult(&acc);
+}
+
+// Views are summed a row at a time in blocks of whole rows (columns for a
+// column-major view); the split still depends only on the shape
+double sumMatrix(const Matrix_t *matrix)
+{
+  if (matrixRequireF32(matrix, "Sum") != 0)
+    return 0.0;
+
+  SumTask task;
+  task.data = matrix->data;
+  task.n = (size_t)matrix->rows * matrix->cols;
+  task.block = sumBlockSize(task.n);
+  task.view = NULL;
+
+  Matrix_t view = matrix->colStride != 1 ? matrixTransposeView(matrix) : *matrix;
+  if (!matrixIsContiguous(matrix))
+  {
+    size_t cols = view.cols > 0 ? (size_t)view.cols : 1;
+    task.view = &view;
+    task.n = (size_t)view.rows;
+    task.block = (sumBlockSize(task.n * cols) + cols - 1) / cols;
+  }
+
+  int blocks = (int)((task.n + task.block - 1) / task.block);
+  matrixParallelFor(blocks, sumTaskRun, &task, (size_t)matrix->rows * matrix->cols);
+  return sumPartials(task.partial, blocks);
+}
+
+double meanMatrix(const Matrix_t *matrix)
+{
+  if (matrixRequireF32(matrix, "Mean") != 0)
+    return 0.0;
+  double sum = sumMatrix(matrix);
+  return sum / ((double)matrix->rows * matrix->cols);
+}
+
+// Lazy expressions
+// exprAdd/exprScale/exprMatmul only record a tree (nodes live in an arena);
+// nothing is computed until exprSum/exprMean/exprEvalInto. Element-wise
+// subtrees are evaluated a cache-sized chunk at a time and consumed right
+// away, so mean(A + B) is one pass over A and B with no temporary matrix.
+// A product is never formed just to be reduced:
+//   sum(L * R) = sum_k colsum(L)[k] * rowsum(R)[k]
+// which reads L and R once each instead of doing the O(m*n*k) multiply.
+#define EXPR_CHUNK SUM_LEAF
+
+typedef enum MatrixExprOp
+{
+  EXPR_MATRIX,
+  EXPR_ADD,
+  EXPR_SCALE,
+  EXPR_MATMUL
+} MatrixExprOp;
+
+typedef struct MatrixExpr
+{
+  MatrixExprOp op;
+  int rows;
+  int cols;
+  const Matrix_t *matrix; // EXPR_MATRIX
+  const struct MatrixExpr *lhs;
+  const struct MatrixExpr *rhs; // EXPR_ADD, EXPR_MATMUL
+  MATRIX_TYPE scale;            // EXPR_SCALE (operand in lhs)
+  double *marginals;            // EXPR_MATMUL: exprSum scratch, 2 * lhs->cols
+} MatrixExpr;
+
+static MatrixExpr *newExprNode(MatrixArena *arena, MatrixExprOp op, int rows, int cols)
+{
+  MatrixExpr *e = (MatrixExpr *)arenaAlloc(arena, sizeof(*e));
+  if (!e)
+    return NULL;
+  e->op = op;
+  e->rows = rows;
+  e->cols = cols;
+  e->matrix = NULL;
+  e->lhs = e->rhs = NULL;
+  e->scale = 1;
+  e->marginals = NULL;
+  return e;
+}
+
+// Constructors pass a NULL operand through, so a failed sub-expression
+// only has to be checked once at the end
+MatrixExpr *exprMatrix(MatrixArena *arena, const Matrix_t *matrix)
+{
+  if (!matrix || !matrix->data)
+  {
+    fprintf(stderr, "Error: Invalid matrix pointer.\n");
+    return NULL;
+  }
+  if (matrixRequireF32(matrix, "Expression") != 0)
+    return NULL;
+
+  MatrixExpr *e = newExprNode(arena, EXPR_MATRIX, matrix->rows, matrix->cols);
+  if (e)
+    e->matrix = matrix;
+  return e;
+}
+
+MatrixExpr *exprAdd(MatrixArena *arena, const MatrixExpr *lhs, const MatrixExpr *rhs)
+{
+  if (!lhs || !rhs)
+    return NULL;
+  if (lhs->rows != rhs->rows || lhs->cols != rhs->cols)
+  {
+    fprintf(stderr, "Error: Matrices must have the same dimensions for addition.\n");
+    return NULL;
+  }
+
+  MatrixExpr *e = newExprNode(arena, EXPR_ADD, lhs->rows, lhs->cols);
+  if (e)
+  {
+    e->lhs = lhs;
+    e->rhs = rhs;
+  }
+  return e;
+}
+
+MatrixExpr *exprScale(MatrixArena *arena, MATRIX_TYPE scale, const MatrixExpr *operand)
+{
+  if (!operand)
+    return NULL;
+
+  MatrixExpr *e = newExprNode(arena, EXPR_SCALE, operand->rows, operand->cols);
+  if (e)
+  {
+    e->lhs = operand;
+    e->scale = scale;
+  }
+  return e;
+}
+
+MatrixExpr *exprMatmul(MatrixArena *arena, const MatrixExpr *lhs, const MatrixExpr *rhs)
+{
+  if (!lhs || !rhs)
+    return NULL;
+  if (lhs->cols != rhs->rows)
+  {
+    fprintf(stderr, "Error: Number of columns in A must equal number of rows in B for multiplication.\n");
+    return NULL;
+  }
+
+  // exprSum's scratch comes from the arena too, so summing a product of
+  // leaves never allocates
+  MatrixExpr *e = newExprNode(arena, EXPR_MATMUL, lhs->rows, rhs->cols);
+  double *marginals = e ? (double *)arenaAlloc(arena, sizeof(double) * 2 * (size_t)lhs->cols) : NULL;
+  if (!marginals)
+    return NULL;
+  e->lhs = lhs;
+  e->rhs = rhs;
+  e->marginals = marginals;
+  return e;
+}
+
+static int exprIsElementwise(const MatrixExpr *e)
+{
+  switch (e->op)
+  {
+  case EXPR_MATRIX:
+    return 1;
+  case EXPR_SCALE:
+    return exprIsElementwise(e->lhs);
+  case EXPR_ADD:
+    return exprIsElementwise(e->lhs) && exprIsElementwise(e->rhs);
+  default:
+    return 0;
+  }
+}
+
+// Elements [offset, offset + len) (row-major order) of an element-wise tree,
+// len <= EXPR_CHUNK. Contiguous leaves are returned in place; views are
+// gathered and anything else is computed into buf.
+static const MATRIX_TYPE *exprChunk(const MatrixExpr *e, size_t offset, size_t len, MATRIX_TYPE *buf)
+{
+  if (e->op == EXPR_MATRIX)
+  {
+    const Matrix_t *m = e->matrix;
+    if (matrixIsContiguous(m))
+      return m->data + offset;
+    size_t i = offset / m->cols, j = offset % m->cols;
+    for (size_t c = 0; c < len; c++)
+    {
+      buf[c] = MATRIX_AT(m, i, j);
+      if (++j == (size_t)m->cols)
+      {
+        j = 0;
+        i++;
+      }
+    }
+    return buf;
+  }
+
+  if (e->op == EXPR_SCALE)
+  {
+    const MATRIX_TYPE *src = exprChunk(e->lhs, offset, len, buf);
+    for (size_t i = 0; i < len; i++)
+      buf[i] = e->scale * src[i];
+    return buf;
+  }
+
+  MATRIX_TYPE tmp[EXPR_CHUNK];
+  const MATRIX_TYPE *a = exprChunk(e->lhs, offset, len, buf);
+  const MATRIX_TYPE *b = exprChunk(e->rhs, offset, len, tmp);
+  matrixKernels()->add(a, b, buf, len);
+  return buf;
+}
+
+typedef struct ExprSumTask
+{
+  const MatrixExpr *expr;
+  size_t n;
+  size_t block;
+  double partial[SUM_MAX_BLOCKS];
+} ExprSumTask;
+
+static void exprSumTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  ExprSumTask *t = (ExprSumTask *)ctx;
+  MATRIX_TYPE buf[EXPR_CHUNK];
+  size_t begin = (size_t)task * t->block;
+  size_t end = begin + t->block < t->n ? begin + t->block : t->n;
+
+  SumAccumulator acc;
+  sumAccInit(&acc);
+  for (size_t i = begin; i < end; i += EXPR_CHUNK)
+  {
+    size_t len = end - i < EXPR_CHUNK ? end - i : EXPR_CHUNK;
+    sumAccAdd(&acc, sumRange(exprChunk(t->expr, i, len, buf), len));
+  }
+  t->partial[task] = sumAccResult(&acc);
+}
+
+// Same fixed-block split as sumMatrix
+static double exprSumElementwise(const MatrixExpr *e)
+{
+  ExprSumTask task;
+  task.expr = e;
+  task.n = (size_t)e->rows * e->cols;
+  task.block = sumBlockSize(task.n);
+
+  int blocks = (int)((task.n + task.block - 1) / task.block);
+  matrixParallelFor(blocks, exprSumTaskRun, &task, task.n);
+  return sumPartials(task.partial, blocks);
+}
+
+int exprEvalInto(const MatrixExpr *e, Matrix_t *result);
+
+// Evaluate a non-element-wise operand into a temporary (NULL for leaves)
+static Matrix_t *exprMaterialize(const MatrixExpr *e, const Matrix_t **view)
+{
+  if (e->op == EXPR_MATRIX)
+  {
+    *view = e->matrix;
+    return NULL;
+  }
+
+  Matrix_t *tmp = newMatrix(e->rows, e->cols);
+  if (!tmp || exprEvalInto(e, tmp) != 0)
+  {
+    deleteMatrix(tmp);
+    *view = NULL;
+    return NULL;
+  }
+  *view = tmp;
+  return tmp;
+}
+
+// Row sums (along = 1, length rows) or column sums (along = 0, length cols)
+// of an expression, in one pass over element-wise trees
+static int exprMarginals(const MatrixExpr *e, int along, double *out)
+{
+  int len = along ? e->rows : e->cols;
+  for (int i = 0; i < len; i++)
+    out[i] = 0.0;
+
+  const Matrix_t *view = NULL;
+  Matrix_t *tmp = NULL;
+  const MatrixExpr *src = e;
+  MatrixExpr leaf;
+  if (!exprIsElementwise(e))
+  {
+    tmp = exprMaterialize(e, &view);
+    if (!view)
+      return -1;
+    leaf.op = EXPR_MATRIX;
+    leaf.rows = view->rows;
+    leaf.cols = view->cols;
+    leaf.matrix = view;
+    src = &leaf;
+  }
+
+  MATRIX_TYPE buf[EXPR_CHUNK];
+  for (int i = 0; i < e->rows; i++)
+  {
+    for (int j = 0; j < e->cols; j += EXPR_CHUNK)
+    {
+      int n = e->cols - j < EXPR_CHUNK ? e->cols - j : EXPR_CHUNK;
+      const MATRIX_TYPE *chunk = exprChunk(src, (size_t)i * e->cols + j, (size_t)n, buf);
+      if (along)
+        out[i] += matrixKernels()->sum(chunk, (size_t)n);
+      else
+        for (int c = 0; c < n; c++)
+          out[j + c] += chunk[c];
+    }
+  }
+  deleteMatrix(tmp);
+  return 0;
+}
+
+double exprSum(const MatrixExpr *e)
+{
+  if (!e)
+  {
+    fprintf(stderr, "Error: Invalid expression.\n");
+    return 0.0;
+  }
+
+  if (exprIsElementwise(e))
+    return exprSumElementwise(e);
+
+  switch (e->op)
+  {
+  case EXPR_SCALE:
+    return e->scale * exprSum(e->lhs);
+  case EXPR_ADD:
+    return exprSum(e->lhs) + exprSum(e->rhs);
+  default:
+    break;
+  }
+
+  // EXPR_MATMUL: colsum(L) . rowsum(R)
+  int inner = e->lhs->cols;
+  double *colSums = e->marginals;
+  double *rowSums = colSums + inner;
+
+  double sum = 0.0;
+  if (exprMarginals(e->lhs, 0, colSums) == 0 && exprMarginals(e->rhs, 1, rowSums) == 0)
+    for (int k = 0; k < inner; k++)
+      sum += colSums[k] * rowSums[k];
+  return sum;
+}
+
+double exprMean(const MatrixExpr *e)
+{
+  if (!e)
+  {
+    fprintf(stderr, "Error: Invalid expression.\n");
+    return 0.0;
+  }
+  return exprSum(e) / ((double)e->rows * e->cols);
+}
+
+// Materialize an expression; result must not alias any of its matrices
+int exprEvalInto(const MatrixExpr *e, Matrix_t *result)
+{
+  if (!e)
+  {
+    fprintf(stderr, "Error: Invalid expression.\n");
+    return -1;
+  }
+
+  if (!result || !result->data || result->rows != e->rows || result->cols != e->cols)
+  {
+    fprintf(stderr, "Error: Result matrix must be %dx%d for expression.\n", e->rows, e->cols);
+    return -1;
+  }
+  if (matrixRequireWritable(result, "Expression"))
+    return -1;
+
+  if (exprIsElementwise(e) && matrixIsContiguous(result))
+  {
+    size_t n = (size_t)e->rows * e->cols;
+    MATRIX_TYPE buf[EXPR_CHUNK];
+    for (size_t i = 0; i < n; i += EXPR_CHUNK)
+    {
+      size_t len = n - i < EXPR_CHUNK ? n - i : EXPR_CHUNK;
+      const MATRIX_TYPE *chunk = exprChunk(e, i, len, buf);
+      for (size_t c = 0; c < len; c++)
+        result->data[i + c] = chunk[c];
+    }
+    return 0;
+  }
+
+  if (exprIsElementwise(e))
+  {
+    MATRIX_TYPE buf[EXPR_CHUNK];
+    for (int i = 0; i < e->rows; i++)
+      for (int j = 0; j < e->cols; j += EXPR_CHUNK)
+      {
+        int len = e->cols - j < EXPR_CHUNK ? e->cols - j : EXPR_CHUNK;
+        const MATRIX_TYPE *chunk = exprChunk(e, (size_t)i * e->cols + j, (size_t)len, buf);
+        for (int c = 0; c < len; c++)
+          MATRIX_AT(result, i, j + c) = chunk[c];
+      }
+    return 0;
+  }
+
+  if (e->op == EXPR_SCALE)
+  {
+    if (exprEvalInto(e->lhs, result) != 0)
+      return -1;
+    for (int i = 0; i < e->rows; i++)
+      for (int j = 0; j < e->cols; j++)
+        MATRIX_AT(result, i, j) *= e->scale;
+    return 0;
+  }
+
+  const Matrix_t *lhs, *rhs;
+  Matrix_t *lhsTmp = NULL, *rhsTmp = NULL;
+  int status = -1;
+  if (e->op == EXPR_ADD)
+  {
+    rhsTmp = exprMaterialize(e->rhs, &rhs);
+    if (rhs && exprEvalInto(e->lhs, result) == 0)
+      status = addMatricesInto(result, rhs, result);
+  }
+  else
+  {
+    lhsTmp = exprMaterialize(e->lhs, &lhs);
+    rhsTmp = exprMaterialize(e->rhs, &rhs);
+    if (lhs && rhs)
+      status = multiplyMatricesInto(lhs, rhs, result);
+  }
+  deleteMatrix(lhsTmp);
+  deleteMatrix(rhsTmp);
+  return status;
+}
+
+// Random numbers
+// Counter-based generator: value i of a stream is a keyed hash of
+// (counter + i), so there is no hidden state to serialize on. Any range of
+// a stream can be produced on its own, which lets the pool fill disjoint
+// ranges in parallel and still give the same numbers for every thread
+// count. Distinct stream ids give independent generators for user threads.
+typedef struct MatrixRng
+{
+  uint64_t key;
+  uint64_t counter;
+} MatrixRng;
+
+static uint64_t splitmix64(uint64_t x)
+{
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+MatrixRng matrixRngStream(uint64_t seed, uint64_t stream)
+{
+  MatrixRng rng = {splitmix64(seed ^ splitmix64(stream)), 0};
+  return rng;
+}
+
+static MatrixRng matrixRng = {0x2545F4914F6CDD1Dull, 0};
+
+// Reseed the generator behind makeMatrixRandom (same seed, same matrices)
+void matrixSeedRandom(uint64_t seed)
+{
+  matrixRng = matrixRngStream(seed, 0);
+}
+
+// Values for counters [counter, counter + n), split where the low word wraps
+static void rngFill(uint64_t key, uint64_t counter, MATRIX_TYPE *out, size_t n)
+{
+  const MatrixKernels *k = matrixKernels();
+  while (n > 0)
+  {
+    uint32_t lo = (uint32_t)counter;
+    uint64_t room = ((uint64_t)1 << 32) - lo;
+    size_t len = n < room ? n : (size_t)room;
+    uint32_t hiMix = rngMix32((uint32_t)(counter >> 32) ^ (uint32_t)(key >> 32));
+    k->fillUniform(out, len, lo, (uint32_t)key, hiMix);
+    out += len;
+    counter += len;
+    n -= len;
+  }
+}
+
+typedef struct FillTask
+{
+  uint64_t key;
+  uint64_t counter;
+  MATRIX_TYPE *out;
+  size_t n;
+  size_t chunk;
+} FillTask;
+
+static void fillTaskRun(void *ctx, int task, int worker)
+{
+  (void)worker;
+  FillTask *t = (FillTask *)ctx;
+  size_t begin = (size_t)task * t->chunk;
+  size_t end = begin + t->chunk < t->n ? begin + t->chunk : t->n;
+  rngFill(t->key, t->counter + begin, t->out + begin, end - begin);
+}
+
+// Uniform [-1, 1) fill from the given stream, advancing it by n
+void fillUniform(MatrixRng *rng, MATRIX_TYPE *out, size_t n)
+{
+  FillTask task = {rng->key, rng->counter, out, n, matrixChunkSize(n, matrixWorkersFor(n))};
+  if (n > 0)
+    matrixParallelFor((int)((n + task.chunk - 1) / task.chunk), fillTaskRun, &task, n);
+  rng->counter += n;
+}
+
+void makeMatrixRandomWith(Matrix_t *matrix, MatrixRng *rng)
+{
+  if (!matrix || !matrix->data || !rng)
+  {
+    fprintf(stderr, "Error: Invalid matrix pointer.\n");
+    return;
+  }
+  if (matrixRequireF32(matrix, "Random fill") || matrixRequireWritable(matrix, "Random fill"))
+    return;
+
+  if (matrixIsContiguous(matrix))
+  {
+    fillUniform(rng, matrix->data, (size_t)matrix->rows * matrix->cols);
+    return;
+  }
+
+  // Views take the values a contiguous matrix of the same shape would get
+  MATRIX_TYPE buf[256];
+  for (int i = 0; i < matrix->rows; i++)
+  {
+    if (matrix->colStride == 1)
+    {
+      fillUniform(rng, &MATRIX_AT(matrix, i, 0), (size_t)matrix->cols);
+      continue;
+    }
+    for (int j = 0; j < matrix->cols; j += 256)
+    {
+      int len = matrix->cols - j < 256 ? matrix->cols - j : 256;
+      fillUniform(rng, buf, (size_t)len);
+      for (int c = 0; c < len; c++)
+        MATRIX_AT(matrix, i, j + c) = buf[c];
+    }
+  }
+}
+
+// Utility function to fill a matrix with random values in [-1, 1)
+void makeMatrixRandom(Matrix_t *matrix)
+{
+  makeMatrixRandomWith(matrix, &matrixRng);
+}
+
+// Matrix files
+// A 64-byte little-endian header followed by the raw elements:
+//   magic "LAB1MAT\0", version, dtype, rows, cols, rowStride (elements
+//   between rows, >= cols), alignment, scale (int8 only), dataOffset
+// dataOffset is a multiple of alignment (at least 64), so a file mapped at a
+// page boundary hands the kernels aligned rows without any copy.
+// loadMatrixMapped maps the file read-only and returns a Matrix_t over the
+// mapping, so opening a multi-GB matrix costs only the page faults for the
+// parts actually read. Such a matrix is an operand only: operations refuse
+// it as a result. MatrixWriter streams rows out through one buffered
+// file so results bigger than memory can be written block by block.
+#define MATRIX_FILE_MAGIC "LAB1MAT"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_ALIGN 64
+
+// Stored dtype codes are MatrixDtype + 1, so a zeroed header is invalid
+typedef enum MatrixFileDtype
+{
+  MATRIX_FILE_F32 = 1,
+  MATRIX_FILE_BF16,
+  MATRIX_FILE_F16,
+  MATRIX_FILE_I8
+} MatrixFileDtype;
+
+typedef struct MatrixFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t dtype;
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t rowStride;
+  uint32_t alignment;
+  float scale;
+  uint64_t dataOffset;
+  uint64_t padding;
+} MatrixFileHeader;
+
+_Static_assert(sizeof(MatrixFileHeader) == 64, "matrix file header must be 64 bytes");
+
+typedef struct MappedMatrix
+{
+  Matrix_t matrix; // first, so a Matrix_t * is a MappedMatrix *
+  void *base;
+  size_t length;
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#endif
+} MappedMatrix;
+
+// Check a header against the file size; returns the data size in bytes or 0
+static uint64_t matrixFileCheckHeader(const MatrixFileHeader *h, uint64_t fileSize, const char *path)
+{
+  if (memcmp(h->magic, MATRIX_FILE_MAGIC, 8) != 0 || h->version != MATRIX_FILE_VERSION)
+  {
+    fprintf(stderr, "Error: '%s' is not a matrix file.\n", path);
+    return 0;
+  }
+  if (h->dtype < MATRIX_FILE_F32 || h->dtype > MATRIX_FILE_I8)
+  {
+    fprintf(stderr, "Error: '%s' has unsupported dtype %u.\n", path, h->dtype);
+    return 0;
+  }
+  if (h->rows > INT32_MAX || h->cols > INT32_MAX || h->rowStride > INT32_MAX || h->rowStride < h->cols ||
+      h->alignment < sizeof(MATRIX_TYPE) || (h->alignment & (h->alignment - 1)) || !(h->scale > 0.0f) ||
+      h->dataOffset < sizeof(*h) || h->dataOffset % h->alignment)
+  {
+    fprintf(stderr, "Error: '%s' has a corrupt header.\n", path);
+    return 0;
+  }
+
+  size_t size = matrixDtypeSize((MatrixDtype)(h->dtype - MATRIX_FILE_F32));
+  // Rows and strides below 2^31 keep the element count below 2^62, but the
+  // byte count could still wrap, so elements are compared instead
+  uint64_t elements = h->rows && h->cols ? (h->rows - 1) * h->rowStride + h->cols : 0;
+  if (h->dataOffset > fileSize || elements > (fileSize - h->dataOffset) / size)
+  {
+    fprintf(stderr, "Error: '%s' is truncated.\n", path);
+    return 0;
+  }
+  return elements ? elements * size : 1;
+}
+
+static void matrixFileFillHeader(MatrixFileHeader *h, int rows, int cols, MatrixDtype dtype, float scale)
+{
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, MATRIX_FILE_MAGIC, 8);
+  h->version = MATRIX_FILE_VERSION;
+  h->dtype = MATRIX_FILE_F32 + (uint32_t)dtype;
+  h->scale = scale;
+  h->rows = (uint64_t)rows;
+  h->cols = (uint64_t)cols;
+  h->rowStride = (uint64_t)cols;
+  h->alignment = MATRIX_FILE_ALIGN;
+  h->dataOffset = (sizeof(*h) + MATRIX_FILE_ALIGN - 1) / MATRIX_FILE_ALIGN * MATRIX_FILE_ALIGN;
+}
+
+Matrix_t *loadMatrixMapped(const char *path)
+{
+  MappedMatrix *mapped = (MappedMatrix *)calloc(1, sizeof(*mapped));
+  if (!mapped)
+  {
+    fprintf(stderr, "Error: Memory allocation failed for mapped matrix.\n");
+    return NULL;
+  }
+
+#ifdef _WIN32
+  LARGE_INTEGER size;
+  mapped->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (mapped->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0)
+  {
+    fprintf(stderr, "Error: Cannot open '%s'.\n", path);
+    if (mapped->file != INVALID_HANDLE_VALUE)
+      CloseHandle(mapped->file);
+    free(mapped);
+    return NULL;
+  }
+  mapped->length = (size_t)size.QuadPart;
+  mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  mapped->base = mapped->mapping ? MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!mapped->base)
+  {
+    fprintf(stderr, "Error: Cannot map '%s'.\n", path);
+    if (mapped->mapping)
+      CloseHandle(mapped->mapping);
+    CloseHandle(mapped->file);
+    free(mapped);
+    return NULL;
+  }
+#else
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    fprintf(stderr, "Error: Cannot open '%s'.\n", path);
+    if (fd >= 0)
+      close(fd);
+    free(mapped);
+    return NULL;
+  }
+  mapped->length = (size_t)st.st_size;
+  mapped->base = mmap(NULL, mapped->length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file open
+  if (mapped->base == MAP_FAILED)
+  {
+    fprintf(stderr, "Error: Cannot map '%s'.\n", path);
+    free(mapped);
+    return NULL;
+  }
+#endif
+
+  mapped->matrix.storage = MATRIX_STORAGE_MAPPED;
+  const MatrixFileHeader *h = (const MatrixFileHeader *)mapped->base;
+  if (mapped->length < sizeof(*h) || !matrixFileCheckHeader(h, mapped->length, path))
+  {
+    unmapMatrixFile(&mapped->matrix);
+    return NULL;
+  }
+
+  mapped->matrix.rows = (int)h->rows;
+  mapped->matrix.cols = (int)h->cols;
+  mapped->matrix.data = (MATRIX_TYPE *)((unsigned char *)mapped->base + h->dataOffset);
+  mapped->matrix.rowStride = (int)h->rowStride;
+  mapped->matrix.colStride = 1;
+  mapped->matrix.dtype = (MatrixDtype)(h->dtype - MATRIX_FILE_F32);
+  mapped->matrix.scale = h->scale;
+  return &mapped->matrix;
+}
+
+static void unmapMatrixFile(Matrix_t *matrix)
+{
+  MappedMatrix *mapped = (MappedMatrix *)matrix;
+#ifdef _WIN32
+  UnmapViewOfFile(mapped->base);
+  CloseHandle(mapped->mapping);
+  CloseHandle(mapped->file);
+#else
+  munmap(mapped->base, mapped->length);
+#endif
+  free(mapped);
+}
+
+// Offsets past 2 GB need more than a 32-bit long
+#ifdef _WIN32
+#define file_seek _fseeki64
+#define file_tell _ftelli64
+#else
+#define file_seek fseeko
+#define file_tell ftello
+#endif
+
+// Read a whole matrix file into a new, writable matrix
+Matrix_t *loadMatrix(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "Error: Cannot open '%s'.\n", path);
+    return NULL;
+  }
+
+  MatrixFileHeader h;
+  Matrix_t *matrix = NULL;
+  if (fread(&h, sizeof(h), 1, file) == 1 && file_seek(file, 0, SEEK_END) == 0)
+  {
+    long long size = file_tell(file);
+    if (size >= 0 && matrixFileCheckHeader(&h, (uint64_t)size, path) &&
+        (matrix = newMatrixOfType((int)h.rows, (int)h.cols, (MatrixDtype)(h.dtype - MATRIX_FILE_F32))) != NULL)
+    {
+      size_t elementSize = matrixDtypeSize(matrix->dtype);
+      int ok = file_seek(file, (long long)h.dataOffset, SEEK_SET) == 0;
+      matrix->scale = h.scale;
+      for (int i = 0; ok && i < matrix->rows; i++)
+      {
+        ok = fread(matrixAddress(matrix, i, 0), elementSize, (size_t)matrix->cols, file) == (size_t)matrix->cols;
+        if (ok && h.rowStride > h.cols && i + 1 < matrix->rows)
+          ok = file_seek(file, (long long)((h.rowStride - h.cols) * elementSize), SEEK_CUR) == 0;
+      }
+      if (!ok)
+      {
+        fprintf(stderr, "Error: Failed to read '%s'.\n", path);
+        deleteMatrix(matrix);
+        matrix = NULL;
+      }
+    }
+  }
+  else
+  {
+    fprintf(stderr, "Error: '%s' is not a matrix file.\n", path);
+  }
+  fclose(file);
+  return matrix;
+}
+
+typedef struct MatrixWriter
+{
+  FILE *file;
+  char *path;
+  int rows;
+  int cols;
+  int rowsWritten;
+  int failed;
+  MatrixDtype dtype;
+  float scale;
+} MatrixWriter;
+
+#define MATRIX_WRITER_BUFFER (1 << 20)
+
+// Start a rows x cols matrix file; rows are then appended with
+// writeMatrixRows. An int8 file needs its scale up front.
+MatrixWriter *beginMatrixFileOfType(const char *path, int rows, int cols, MatrixDtype dtype, float scale)
+{
+  if (rows < 0 || cols < 0)
+  {
+    fprintf(stderr, "Error: Invalid matrix file dimensions %dx%d.\n", rows, cols);
+    return NULL;
+  }
+
+  MatrixWriter *writer = (MatrixWriter *)calloc(1, sizeof(*writer));
+  if (!writer)
+  {
+    fprintf(stderr, "Error: Memory allocation failed for matrix writer.\n");
+    return NULL;
+  }
+
+  writer->file = fopen(path, "wb");
+  if (!writer->file)
+  {
+    fprintf(stderr, "Error: Cannot open '%s' for writing.\n", path);
+    free(writer);
+    return NULL;
+  }
+  setvbuf(writer->file, NULL, _IOFBF, MATRIX_WRITER_BUFFER);
+  writer->path = (char *)malloc(strlen(path) + 1);
+  if (writer->path)
+    strcpy(writer->path, path);
+  writer->rows = rows;
+  writer->cols = cols;
+  writer->dtype = dtype;
+  writer->scale = dtype == MATRIX_I8 ? scale : 1.0f;
+
+  MatrixFileHeader h;
+  matrixFileFillHeader(&h, rows, cols, dtype, writer->scale);
+  static const unsigned char zeros[MATRIX_FILE_ALIGN] = {0};
+  if (fwrite(&h, sizeof(h), 1, writer->file) != 1 ||
+      fwrite(zeros, 1, (size_t)h.dataOffset - sizeof(h), writer->file) != (size_t)h.dataOffset - sizeof(h))
+    writer->failed = 1;
+  return writer;
+}
+
+MatrixWriter *beginMatrixFile(const char *path, int rows, int cols)
+{
+  return beginMatrixFileOfType(path, rows, cols, MATRIX_F32, 1.0f);
+}
+
+// Append the rows of block (any matrix or view with the file's column count)
+int writeMatrixRows(MatrixWriter *writer, const Matrix_t *block)
+{
+  if (!writer || !block || !block->data || block->cols != writer->cols ||
+      block->rows > writer->rows - writer->rowsWritten || block->dtype != writer->dtype ||
+      (block->dtype == MATRIX_I8 && block->scale != writer->scale))
+  {
+    fprintf(stderr, "Error: Block does not fit the matrix file.\n");
+    if (writer)
+      writer->failed = 1;
+    return -1;
+  }
+
+  size_t elementSize = matrixDtypeSize(block->dtype);
+  unsigned char buf[256 * sizeof(MATRIX_TYPE)];
+  for (int i = 0; i < block->rows && !writer->failed; i++)
+  {
+    if (block->colStride == 1)
+    {
+      if (fwrite(matrixAddress(block, i, 0), elementSize, (size_t)block->cols, writer->file) != (size_t)block->cols)
+        writer->failed = 1;
+      continue;
+    }
+    for (int j = 0; j < block->cols && !writer->failed; j += 256)
+    {
+      int len = block->cols - j < 256 ? block->cols - j : 256;
+      for (int c = 0; c < len; c++)
+        memcpy(buf + c * elementSize, matrixAddress(block, i, j + c), elementSize);
+      if (fwrite(buf, elementSize, (size_t)len, writer->file) != (size_t)len)
+        writer->failed = 1;
     }
   }
-  return result;
-}
 
-double sumMatrix(const Matrix_t *matrix)
-{
-  double sum = 0.0;
-  for (int i = 0; i < matrix->rows * matrix->cols; i++)
+  if (writer->failed)
   {
-    sum += matrix->data[i];
+    fprintf(stderr, "Error: Failed to write '%s'.\n", writer->path ? writer->path : "matrix file");
+    return -1;
   }
-  return sum;
+  writer->rowsWritten += block->rows;
+  return 0;
 }
 
-double meanMatrix(const Matrix_t *matrix)
+// Finish the file; fails (and removes it) unless every row was written
+int endMatrixFile(MatrixWriter *writer)
 {
-  double sum = sumMatrix(matrix);
-  return sum / (matrix->rows * matrix->cols);
+  if (!writer)
+    return -1;
+
+  int status = 0;
+  if (!writer->failed && writer->rowsWritten != writer->rows)
+  {
+    fprintf(stderr, "Error: Matrix file got %d of %d rows.\n", writer->rowsWritten, writer->rows);
+    status = -1;
+  }
+  if (fclose(writer->file) != 0 || writer->failed)
+    status = -1;
+  if (status != 0 && writer->path)
+    remove(writer->path);
+  free(writer->path);
+  free(writer);
+  return status;
 }
 
-// Utility function to fill a matrix with random values
-void makeMatrixRandom(Matrix_t *matrix)
+int saveMatrix(const char *path, const Matrix_t *matrix)
 {
   if (!matrix || !matrix->data)
   {
     fprintf(stderr, "Error: Invalid matrix pointer.\n");
-    return;
+    return -1;
   }
 
-  for (int i = 0; i < matrix->rows * matrix->cols; i++)
-  {
-    matrix->data[i] = (MATRIX_TYPE)rand() / RAND_MAX; // Random float between 0 and 1
-    matrix->data[i] = matrix->data[i] * 2.0f - 1.0f;  // Scale to range [-1, 1]
-  }
+  MatrixWriter *writer = beginMatrixFileOfType(path, matrix->rows, matrix->cols, matrix->dtype, matrix->scale);
+  if (!writer)
+    return -1;
+  int status = writeMatrixRows(writer, matrix);
+  return endMatrixFile(writer) == 0 ? status : -1;
 }
 
 void plotResults(double *addResults, double *multResults, int numIterations, const char *outputFile)
@@ -188,69 +4141,858 @@ void plotResults(double *addResults, double *multResults, int numIterations, con
   fclose(output);
 }
 
-int main()
+// Streaming statistics
+// Samples are folded in one at a time: Welford's update keeps the running
+// mean and the sum of squared deviations (M2) without the cancellation of
+// sum(x^2) - n mean^2, and the histogram has a fixed range and bin count
+// chosen up front. A StreamStats is a fixed-size value, so a collector of a
+// billion samples takes as much memory as one of ten. Two collectors over
+// disjoint samples combine exactly with streamStatsMerge.
+#define STREAM_STATS_MAX_BINS 64
+
+typedef struct StreamStats
 {
-  const char *outputFile = "results.txt";
-  srand((unsigned int)time(NULL));
-  int numIterations = 10;
-  double addResults[20];
-  double MultResults[20];
+  uint64_t count;
+  double mean;
+  double m2; // sum of squared deviations from the mean
+  double min;
+  double max;
+  double lo, hi; // histogram range [lo, hi)
+  int numBins;
+  uint64_t below, above, nans; // outside the histogram (NaNs are not in count)
+  uint64_t bins[STREAM_STATS_MAX_BINS];
+} StreamStats;
+
+void streamStatsInit(StreamStats *s, double lo, double hi, int numBins)
+{
+  memset(s, 0, sizeof(*s));
+  s->lo = lo;
+  s->hi = hi > lo ? hi : lo + 1.0;
+  s->numBins = numBins < 1 ? 1 : numBins > STREAM_STATS_MAX_BINS ? STREAM_STATS_MAX_BINS : numBins;
+  s->min = INFINITY;
+  s->max = -INFINITY;
+}
+
+void streamStatsAdd(StreamStats *s, double x)
+{
+  if (x != x)
+  {
+    s->nans++;
+    return;
+  }
+
+  s->count++;
+  double delta = x - s->mean;
+  s->mean += delta / (double)s->count;
+  s->m2 += delta * (x - s->mean);
+  s->min = x < s->min ? x : s->min;
+  s->max = x > s->max ? x : s->max;
+
+  if (x < s->lo)
+    s->below++;
+  else if (x >= s->hi)
+    s->above++;
+  else
+  {
+    int bin = (int)((x - s->lo) / (s->hi - s->lo) * s->numBins);
+    s->bins[bin < s->numBins ? bin : s->numBins - 1]++;
+  }
+}
+
+// Fold b into a (Chan et al.); both must share the histogram layout
+int streamStatsMerge(StreamStats *a, const StreamStats *b)
+{
+  if (a->lo != b->lo || a->hi != b->hi || a->numBins != b->numBins)
+  {
+    fprintf(stderr, "Error: Cannot merge statistics with different histograms.\n");
+    return -1;
+  }
+  if (b->count > 0)
+  {
+    double n = (double)a->count + (double)b->count, delta = b->mean - a->mean;
+    a->mean += delta * (double)b->count / n;
+    a->m2 += b->m2 + delta * delta * (double)a->count * (double)b->count / n;
+    a->count += b->count;
+    a->min = b->min < a->min ? b->min : a->min;
+    a->max = b->max > a->max ? b->max : a->max;
+  }
+  a->below += b->below;
+  a->above += b->above;
+  a->nans += b->nans;
+  for (int i = 0; i < a->numBins; i++)
+    a->bins[i] += b->bins[i];
+  return 0;
+}
+
+// Sample variance (n - 1 denominator)
+double streamStatsVariance(const StreamStats *s)
+{
+  return s->count > 1 ? s->m2 / (double)(s->count - 1) : 0.0;
+}
+
+// Results files
+// Samples are appended as text rows through a large stdio buffer, so the
+// file grows in buffer-sized writes while the run goes on and is never
+// reopened or rewritten. Summaries and histograms go at the end.
+typedef struct ResultsWriter
+{
+  FILE *file;
+  uint64_t rowsWritten;
+  int failed;
+} ResultsWriter;
+
+#define RESULTS_WRITER_BUFFER (1 << 16)
+
+// Truncate path (NULL writes to stdout) and write a "# sample <columns>" header
+ResultsWriter *beginResultsFile(const char *path, const char *columns)
+{
+  ResultsWriter *writer = (ResultsWriter *)calloc(1, sizeof(*writer));
+  if (!writer)
+  {
+    fprintf(stderr, "Error: Memory allocation failed for results writer.\n");
+    return NULL;
+  }
+
+  writer->file = path ? fopen(path, "w") : stdout;
+  if (!writer->file)
+  {
+    fprintf(stderr, "Error: Cannot open '%s' for writing.\n", path);
+    free(writer);
+    return NULL;
+  }
+  if (path)
+    setvbuf(writer->file, NULL, _IOFBF, RESULTS_WRITER_BUFFER);
+  if (fprintf(writer->file, "# sample %s\n", columns ? columns : "value") < 0)
+    writer->failed = 1;
+  return writer;
+}
+
+// Append one row: the running sample number, then the values
+int writeResultsRow(ResultsWriter *writer, const double *values, int numValues)
+{
+  if (!writer || writer->failed)
+    return -1;
+
+  int ok = fprintf(writer->file, "%llu", (unsigned long long)writer->rowsWritten) >= 0;
+  for (int i = 0; ok && i < numValues; i++)
+    ok = fprintf(writer->file, " %.6f", values[i]) >= 0;
+  if (!ok || fputc('\n', writer->file) == EOF)
+  {
+    fprintf(stderr, "Error: Failed to write results row %llu.\n", (unsigned long long)writer->rowsWritten);
+    writer->failed = 1;
+    return -1;
+  }
+  writer->rowsWritten++;
+  return 0;
+}
+
+// Append a summary of s and its histogram as a text bar chart
+int writeResultsStats(ResultsWriter *writer, const char *name, const StreamStats *s)
+{
+  if (!writer || writer->failed)
+    return -1;
+
+  FILE *output = writer->file;
+  fprintf(output, "\n# %s: n=%llu mean=%.6f sd=%.6f min=%.6f max=%.6f\n", name, (unsigned long long)s->count,
+          s->mean, sqrt(streamStatsVariance(s)), s->count ? s->min : 0.0, s->count ? s->max : 0.0);
+  uint64_t peak = 1;
+  for (int i = 0; i < s->numBins; i++)
+    peak = s->bins[i] > peak ? s->bins[i] : peak;
+
+  char stars[51];
+  double width = (s->hi - s->lo) / s->numBins;
+  for (int i = 0; i < s->numBins; i++)
+  {
+    int numStars = (int)(s->bins[i] * 50 / peak);
+    memset(stars, '*', (size_t)numStars);
+    stars[numStars] = '\0';
+    fprintf(output, "# [%8.3f, %8.3f) %10llu%s%s\n", s->lo + i * width, s->lo + (i + 1) * width,
+            (unsigned long long)s->bins[i], numStars ? " " : "", stars);
+  }
+  if (s->below || s->above || s->nans)
+    fprintf(output, "# below %llu, above %llu, NaN %llu\n", (unsigned long long)s->below,
+            (unsigned long long)s->above, (unsigned long long)s->nans);
+  if (ferror(output))
+  {
+    fprintf(stderr, "Error: Failed to write results summary.\n");
+    writer->failed = 1;
+    return -1;
+  }
+  return 0;
+}
+
+int endResultsFile(ResultsWriter *writer)
+{
+  if (!writer)
+    return -1;
+
+  int status = writer->failed ? -1 : 0;
+  if (writer->file == stdout ? fflush(stdout) != 0 : fclose(writer->file) != 0)
+    status = -1;
+  free(writer);
+  return status;
+}
+
+// Benchmarks
+static double benchNow(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
 
-  for (int i = 0; i < 1000; ++i)
+// Base kernel vs Strassen-Winograd on n x n; GFLOP/s counts 2n^3 for both
+// so the Strassen column is an effective rate
+void benchmarkStrassen(const int *sizes, int numSizes, int trials)
+{
+  printf("| %6s | %10s | %8s | %13s | %8s | %7s | %10s |\n",
+         "n", "base ms", "GFLOP/s", "strassen ms", "GFLOP/s", "speedup", "max |diff|");
+  printf("|-%6s-|-%10s-|-%8s-|-%13s-|-%8s-|-%7s-|-%10s-|\n",
+         "------", "----------", "--------", "-------------", "--------", "-------", "----------");
+  for (int s = 0; s < numSizes; s++)
   {
-    Matrix_t *A = newMatrix(2, 3);
-    Matrix_t *B = newMatrix(2, 3);
-    if (!A || !B)
+    int n = sizes[s];
+    Matrix_t *A = newMatrix(n, n);
+    Matrix_t *B = newMatrix(n, n);
+    Matrix_t *C = newMatrix(n, n);
+    Matrix_t *D = newMatrix(n, n);
+    if (!A || !B || !C || !D)
     {
-      fprintf(stderr, "Error: Failed to create matrices.\n");
+      fprintf(stderr, "Error: Failed to create %dx%d benchmark matrices.\n", n, n);
       deleteMatrix(A);
       deleteMatrix(B);
-      return EXIT_FAILURE;
+      deleteMatrix(C);
+      deleteMatrix(D);
+      continue;
     }
-    for (int t = 0; t < numIterations; t++)
+    makeMatrixRandom(A);
+    makeMatrixRandom(B);
+
+    // Best of trials, after one warm-up run each
+    double base = 1e30, fast = 1e30;
+    for (int t = 0; t <= trials; t++)
     {
-      makeMatrixRandom(A);
-      makeMatrixRandom(B);
-      Matrix_t *C = addMatrices(A, B);
-      if (!C)
+      double start = benchNow();
+      multiplyMatricesInto(A, B, C);
+      double mid = benchNow();
+      multiplyMatricesStrassenInto(A, B, D);
+      double end = benchNow();
+      if (t > 0)
       {
-        fprintf(stderr, "Error: Failed to add matrices.\n");
-        deleteMatrix(A);
-        deleteMatrix(B);
-        return EXIT_FAILURE;
+        base = mid - start < base ? mid - start : base;
+        fast = end - mid < fast ? end - mid : fast;
       }
+    }
 
-      addResults[t] = meanMatrix(C);
-      deleteMatrix(C);
+    double diff = 0.0;
+    for (size_t i = 0; i < (size_t)n * n; i++)
+    {
+      double d = C->data[i] > D->data[i] ? C->data[i] - D->data[i] : D->data[i] - C->data[i];
+      diff = d > diff ? d : diff;
     }
 
+    double flops = 2.0 * n * n * n;
+    printf("| %6d | %10.1f | %8.1f | %13.1f | %8.1f | %6.2fx | %10.2e |\n",
+           n, base * 1e3, flops / base * 1e-9, fast * 1e3, flops / fast * 1e-9, base / fast, diff);
     deleteMatrix(A);
     deleteMatrix(B);
-    A = newMatrix(2, 3);
-    B = newMatrix(3, 2);
-    for (int t = 0; t < numIterations; t++)
+    deleteMatrix(C);
+    deleteMatrix(D);
+  }
+}
+
+// Reduced-precision GEMM against the f32 path: time, operand bytes and the
+// error of C relative to the f32 product (max elementwise over max |C|, and
+// Frobenius norm). Conversion time is not included.
+void reportDtypeAccuracy(const int *sizes, int numSizes, int trials)
+{
+  static const MatrixDtype dtypes[] = {MATRIX_F32, MATRIX_BF16, MATRIX_F16, MATRIX_I8};
+  printf("| %6s | %5s | %10s | %8s | %9s | %10s | %10s |\n",
+         "n", "dtype", "ms", "GFLOP/s", "A+B MB", "max rel", "frob rel");
+  printf("|-%6s-|-%5s-|-%10s-|-%8s-|-%9s-|-%10s-|-%10s-|\n",
+         "------", "-----", "----------", "--------", "---------", "----------", "----------");
+  for (int s = 0; s < numSizes; s++)
+  {
+    int n = sizes[s];
+    Matrix_t *A = newMatrix(n, n);
+    Matrix_t *B = newMatrix(n, n);
+    Matrix_t *ref = newMatrix(n, n);
+    Matrix_t *C = newMatrix(n, n);
+    if (!A || !B || !ref || !C)
     {
-      makeMatrixRandom(A);
-      makeMatrixRandom(B);
-      Matrix_t *D = multiplyMatrices(A, B);
-      if (!D)
+      fprintf(stderr, "Error: Failed to create %dx%d accuracy matrices.\n", n, n);
+      deleteMatrix(A);
+      deleteMatrix(B);
+      deleteMatrix(ref);
+      deleteMatrix(C);
+      continue;
+    }
+    makeMatrixRandom(A);
+    makeMatrixRandom(B);
+    multiplyMatricesInto(A, B, ref);
+
+    double refMax = 0.0, refNorm = 0.0;
+    for (size_t i = 0; i < (size_t)n * n; i++)
+    {
+      double r = ref->data[i];
+      refMax = (r < 0 ? -r : r) > refMax ? (r < 0 ? -r : r) : refMax;
+      refNorm += r * r;
+    }
+
+    for (size_t d = 0; d < sizeof(dtypes) / sizeof(dtypes[0]); d++)
+    {
+      Matrix_t *Aq = convertMatrix(A, dtypes[d]);
+      Matrix_t *Bq = convertMatrix(B, dtypes[d]);
+      if (!Aq || !Bq)
       {
-        fprintf(stderr, "Error: Failed to multiply matrices.\n");
-        deleteMatrix(A);
-        deleteMatrix(B);
-        return EXIT_FAILURE;
+        deleteMatrix(Aq);
+        deleteMatrix(Bq);
+        continue;
       }
 
-      MultResults[t] = sumMatrix(D);
-      deleteMatrix(D);
+      // Best of trials, after one warm-up run
+      double best = 1e30;
+      for (int t = 0; t <= trials; t++)
+      {
+        double start = benchNow();
+        multiplyMatricesInto(Aq, Bq, C);
+        double elapsed = benchNow() - start;
+        if (t > 0 && elapsed < best)
+          best = elapsed;
+      }
+
+      double maxDiff = 0.0, diffNorm = 0.0;
+      for (size_t i = 0; i < (size_t)n * n; i++)
+      {
+        double e = (double)C->data[i] - ref->data[i];
+        maxDiff = (e < 0 ? -e : e) > maxDiff ? (e < 0 ? -e : e) : maxDiff;
+        diffNorm += e * e;
+      }
+
+      printf("| %6d | %5s | %10.2f | %8.1f | %9.1f | %10.2e | %10.2e |\n", n, matrixDtypeNames[dtypes[d]],
+             best * 1e3, 2.0 * n * n * n / best * 1e-9, 2.0 * n * n * matrixDtypeSize(dtypes[d]) / 1e6,
+             refMax > 0 ? maxDiff / refMax : 0.0, refNorm > 0 ? sqrt(diffNorm / refNorm) : 0.0);
+      deleteMatrix(Aq);
+      deleteMatrix(Bq);
+    }
+    deleteMatrix(A);
+    deleteMatrix(B);
+    deleteMatrix(ref);
+    deleteMatrix(C);
+  }
+}
+
+// Sparse against dense on an n x n matrix with the given fraction of
+// nonzeros: storage, conversion time, SpMV and SpMM (n x n x 64) times next
+// to the dense GEMM doing the same product, and the largest difference
+void reportSparse(const int *sizes, int numSizes, double density, int trials)
+{
+  printf("| %6s | %10s | %9s | %9s | %10s | %10s | %10s | %10s | %10s | %9s |\n", "n", "nnz", "dense MB",
+         "csr MB", "to csr ms", "spmv ms", "gemv ms", "spmm ms", "gemm ms", "max diff");
+  printf("|-%6s-|-%10s-|-%9s-|-%9s-|-%10s-|-%10s-|-%10s-|-%10s-|-%10s-|-%9s-|\n", "------", "----------",
+         "---------", "---------", "----------", "----------", "----------", "----------", "----------",
+         "---------");
+  for (int s = 0; s < numSizes; s++)
+  {
+    int n = sizes[s];
+    Matrix_t *A = newMatrix(n, n);
+    Matrix_t *mask = newMatrix(n, n);
+    Matrix_t *B = newMatrix(n, 64);
+    Matrix_t *C = newMatrix(n, 64);
+    Matrix_t *ref = newMatrix(n, 64);
+    if (!A || !mask || !B || !C || !ref)
+    {
+      fprintf(stderr, "Error: Failed to create %dx%d sparse benchmark matrices.\n", n, n);
+      deleteMatrix(A);
+      deleteMatrix(mask);
+      deleteMatrix(B);
+      deleteMatrix(C);
+      deleteMatrix(ref);
+      continue;
     }
+    makeMatrixRandom(A);
+    makeMatrixRandom(mask);
+    makeMatrixRandom(B);
+    for (size_t i = 0; i < (size_t)n * n; i++)
+      if (mask->data[i] * 0.5 + 0.5 >= density)
+        A->data[i] = 0.0f;
 
-    _sleep(250);
-    plotResults(addResults, MultResults, numIterations, outputFile);
-    // plotResults(addResults, MultResults, numIterations, NULL);
+    double start = benchNow();
+    SparseMatrix_t *sparse = matrixToSparse(A, SPARSE_CSR);
+    double convert = benchNow() - start;
 
+    if (sparse)
+    {
+      // Best of trials after one warm-up run, for each of the four products
+      double best[4] = {1e30, 1e30, 1e30, 1e30};
+      Matrix_t x = matrixColBlock(B, 0, 1), y = matrixColBlock(C, 0, 1), yRef = matrixColBlock(ref, 0, 1);
+      for (int t = 0; t <= trials; t++)
+      {
+        double times[5];
+        times[0] = benchNow();
+        multiplySparseVectorInto(sparse, &x, &y);
+        times[1] = benchNow();
+        multiplyMatricesInto(A, &x, &yRef);
+        times[2] = benchNow();
+        multiplySparseDenseInto(sparse, B, C);
+        times[3] = benchNow();
+        multiplyMatricesInto(A, B, ref);
+        times[4] = benchNow();
+        for (int k = 0; t > 0 && k < 4; k++)
+          if (times[k + 1] - times[k] < best[k])
+            best[k] = times[k + 1] - times[k];
+      }
+
+      double maxDiff = 0.0;
+      for (size_t i = 0; i < (size_t)n * 64; i++)
+      {
+        double e = (double)C->data[i] - ref->data[i];
+        maxDiff = (e < 0 ? -e : e) > maxDiff ? (e < 0 ? -e : e) : maxDiff;
+      }
+
+      printf("| %6d | %10zu | %9.1f | %9.1f | %10.2f | %10.3f | %10.3f | %10.2f | %10.2f | %9.2e |\n", n,
+             sparse->nnz, sizeof(MATRIX_TYPE) * (double)n * n / 1e6,
+             ((n + 1.0) * sizeof(size_t) + sparse->nnz * (sizeof(int) + sizeof(MATRIX_TYPE))) / 1e6, convert * 1e3,
+             best[0] * 1e3, best[1] * 1e3, best[2] * 1e3, best[3] * 1e3, maxDiff);
+    }
+
+    deleteSparseMatrix(sparse);
     deleteMatrix(A);
+    deleteMatrix(mask);
     deleteMatrix(B);
+    deleteMatrix(C);
+    deleteMatrix(ref);
+  }
+}
+
+// Kernel benchmark harness
+// Every (op, shape, size) case is warmed up, then timed over several trials
+// with the monotonic clock. Each trial repeats the op until it has run for
+// at least minTrialSeconds, so small sizes are not lost in timer
+// resolution. Rows report the per-call median, p95 and min with the
+// GFLOP/s and GB/s implied by the median, as CSV or JSON, so runs can be
+// diffed to catch kernel regressions.
+typedef enum BenchOp
+{
+  BENCH_ADD,
+  BENCH_SUM,
+  BENCH_MULTIPLY
+} BenchOp;
+
+typedef struct BenchConfig
+{
+  const int *sizes;
+  int numSizes;
+  int warmup;
+  int trials;
+  double minTrialSeconds;
+  int json;
+  FILE *out;
+} BenchConfig;
+
+typedef struct BenchCase
+{
+  BenchOp op;
+  const char *shape;
+  int m, k, n;
+  Matrix_t *A, *B, *C;
+  volatile double sink;
+} BenchCase;
+
+static void benchRunOnce(BenchCase *c)
+{
+  switch (c->op)
+  {
+  case BENCH_ADD:
+    addMatricesInto(c->A, c->B, c->C);
+    break;
+  case BENCH_SUM:
+    c->sink = sumMatrix(c->A);
+    break;
+  case BENCH_MULTIPLY:
+    multiplyMatricesInto(c->A, c->B, c->C);
+    break;
+  }
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void benchCase(const BenchConfig *config, BenchCase *c, int first)
+{
+  static const char *opNames[] = {"add", "sum", "multiply"};
+  double flops, bytes;
+  size_t mn = (size_t)c->m * c->n;
+  switch (c->op)
+  {
+  case BENCH_ADD:
+    flops = (double)mn;
+    bytes = 3.0 * sizeof(MATRIX_TYPE) * mn;
+    break;
+  case BENCH_SUM:
+    flops = (double)mn;
+    bytes = (double)sizeof(MATRIX_TYPE) * mn;
+    break;
+  default:
+    flops = 2.0 * c->m * c->n * c->k;
+    bytes = (double)sizeof(MATRIX_TYPE) * ((double)c->m * c->k + (double)c->k * c->n + mn);
+    break;
+  }
+
+  for (int w = 0; w < config->warmup; w++)
+    benchRunOnce(c);
+
+  // Calibrate repetitions per trial
+  int reps = 1;
+  for (;;)
+  {
+    double start = benchNow();
+    for (int r = 0; r < reps; r++)
+      benchRunOnce(c);
+    double elapsed = benchNow() - start;
+    if (elapsed >= config->minTrialSeconds || reps >= (1 << 24))
+      break;
+    reps = elapsed > 0 ? (int)(reps * 1.2 * config->minTrialSeconds / elapsed) + 1 : reps * 16;
+  }
+
+  double times[256];
+  int trials = config->trials < 256 ? config->trials : 256;
+  for (int t = 0; t < trials; t++)
+  {
+    double start = benchNow();
+    for (int r = 0; r < reps; r++)
+      benchRunOnce(c);
+    times[t] = (benchNow() - start) / reps;
+  }
+  qsort(times, trials, sizeof(double), compareDoubles);
+  double median = trials % 2 ? times[trials / 2] : 0.5 * (times[trials / 2 - 1] + times[trials / 2]);
+  double p95 = times[(int)(0.95 * (trials - 1) + 0.5)];
+
+  if (config->json)
+    fprintf(config->out,
+            "%s  {\"op\": \"%s\", \"shape\": \"%s\", \"m\": %d, \"k\": %d, \"n\": %d, \"isa\": \"%s\", "
+            "\"threads\": %d, \"trials\": %d, \"reps\": %d, \"median_ms\": %.6f, \"p95_ms\": %.6f, "
+            "\"min_ms\": %.6f, \"gflops\": %.3f, \"gbps\": %.3f}",
+            first ? "" : ",\n", opNames[c->op], c->shape, c->m, c->k, c->n, matrixKernelName(),
+            matrixNumThreads(), trials, reps, median * 1e3, p95 * 1e3, times[0] * 1e3,
+            flops / median * 1e-9, bytes / median * 1e-9);
+  else
+    fprintf(config->out, "%s,%s,%d,%d,%d,%s,%d,%d,%d,%.6f,%.6f,%.6f,%.3f,%.3f\n",
+            opNames[c->op], c->shape, c->m, c->k, c->n, matrixKernelName(), matrixNumThreads(),
+            trials, reps, median * 1e3, p95 * 1e3, times[0] * 1e3,
+            flops / median * 1e-9, bytes / median * 1e-9);
+  fflush(config->out);
+}
+
+// Shapes per size N: add/sum on N x N; multiply as square (N x N x N),
+// rank-64 update (N x 64 x N) and matrix times thin block (N x N x 16)
+void runBenchmarks(const BenchConfig *config)
+{
+  static const struct
+  {
+    BenchOp op;
+    const char *shape;
+  } kinds[] = {
+      {BENCH_ADD, "square"},
+      {BENCH_SUM, "square"},
+      {BENCH_MULTIPLY, "square"},
+      {BENCH_MULTIPLY, "rank64"},
+      {BENCH_MULTIPLY, "thin16"},
+  };
+
+  if (config->json)
+    fprintf(config->out, "[\n");
+  else
+    fprintf(config->out, "op,shape,m,k,n,isa,threads,trials,reps,median_ms,p95_ms,min_ms,gflops,gbps\n");
+
+  int first = 1;
+  for (int s = 0; s < config->numSizes; s++)
+  {
+    int N = config->sizes[s];
+    for (size_t q = 0; q < sizeof(kinds) / sizeof(kinds[0]); q++)
+    {
+      BenchCase c;
+      c.op = kinds[q].op;
+      c.shape = kinds[q].shape;
+      c.m = c.n = c.k = N;
+      if (strcmp(c.shape, "rank64") == 0)
+        c.k = 64;
+      else if (strcmp(c.shape, "thin16") == 0)
+        c.n = 16;
+
+      int bRows = c.op == BENCH_MULTIPLY ? c.k : c.m;
+      c.A = newMatrix(c.m, c.op == BENCH_MULTIPLY ? c.k : c.n);
+      c.B = newMatrix(bRows, c.n);
+      c.C = newMatrix(c.m, c.n);
+      if (!c.A || !c.B || !c.C)
+      {
+        fprintf(stderr, "Error: Failed to create benchmark matrices for N = %d.\n", N);
+      }
+      else
+      {
+        makeMatrixRandom(c.A);
+        makeMatrixRandom(c.B);
+        benchCase(config, &c, first);
+        first = 0;
+      }
+      deleteMatrix(c.A);
+      deleteMatrix(c.B);
+      deleteMatrix(c.C);
+    }
+  }
+
+  if (config->json)
+    fprintf(config->out, "\n]\n");
+}
+
+// lab-1 bench [--csv | --json] [--out FILE] [--sizes N,N,...] [--trials N]
+//             [--warmup N] [--threads N] [--isa scalar|sse2|avx2|avx512]
+static int benchMain(int argc, char **argv)
+{
+  static const char *isaNames[] = {"scalar", "sse2", "avx2", "avx512"};
+  int sizes[64] = {64, 128, 256, 512, 1024, 2048};
+  BenchConfig config = {sizes, 6, 2, 15, 0.01, 0, stdout};
+  const char *outPath = NULL;
+
+  for (int a = 2; a < argc; a++)
+  {
+    const char *arg = argv[a];
+    const char *value = a + 1 < argc ? argv[a + 1] : NULL;
+    if (strcmp(arg, "--csv") == 0)
+      config.json = 0;
+    else if (strcmp(arg, "--json") == 0)
+      config.json = 1;
+    else if (value && strcmp(arg, "--out") == 0)
+      outPath = argv[++a];
+    else if (value && strcmp(arg, "--trials") == 0)
+      config.trials = atoi(argv[++a]);
+    else if (value && strcmp(arg, "--warmup") == 0)
+      config.warmup = atoi(argv[++a]);
+    else if (value && strcmp(arg, "--threads") == 0)
+      matrixSetNumThreads(atoi(argv[++a]));
+    else if (value && strcmp(arg, "--isa") == 0)
+    {
+      a++;
+      int isa = 0;
+      while (isa < 4 && strcmp(value, isaNames[isa]) != 0)
+        isa++;
+      if (isa == 4)
+      {
+        fprintf(stderr, "Error: Unknown ISA '%s'; expected one of:", value);
+        for (int i = 0; i < 4; i++)
+          fprintf(stderr, " %s", isaNames[i]);
+        fprintf(stderr, ".\n");
+        return EXIT_FAILURE;
+      }
+      if (matrixSelectKernels((MatrixIsa)isa) != (MatrixIsa)isa)
+      {
+        fprintf(stderr, "Error: This CPU does not support %s kernels.\n", value);
+        return EXIT_FAILURE;
+      }
+    }
+    else if (value && strcmp(arg, "--sizes") == 0)
+    {
+      char *cursor = argv[++a];
+      config.numSizes = 0;
+      while (*cursor && config.numSizes < 64)
+      {
+        long size = strtol(cursor, &cursor, 10);
+        if (size > 0)
+          sizes[config.numSizes++] = (int)size;
+        while (*cursor == ',' || *cursor == ' ')
+          cursor++;
+        if (*cursor && (*cursor < '0' || *cursor > '9'))
+          break;
+      }
+    }
+    else
+    {
+      fprintf(stderr, "Error: Unknown benchmark option '%s'.\n", arg);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (config.trials < 1 || config.numSizes < 1)
+  {
+    fprintf(stderr, "Error: Need at least one size and one trial.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (outPath)
+  {
+    config.out = fopen(outPath, "w");
+    if (!config.out)
+    {
+      fprintf(stderr, "Error: Cannot open '%s' for writing.\n", outPath);
+      return EXIT_FAILURE;
+    }
   }
+
+  runBenchmarks(&config);
+  if (outPath)
+    fclose(config.out);
+  matrixStopThreads();
   return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char **argv)
+{
+  const char *outputFile = "results.txt";
+  matrixSeedRandom((uint64_t)time(NULL));
+
+  // lab-1 strassen [n ...]: Strassen-Winograd vs base kernel table
+  if (argc > 1 && strcmp(argv[1], "strassen") == 0)
+  {
+    int sizes[32] = {1024, 2048, 4096};
+    int numSizes = argc > 2 ? 0 : 3;
+    for (int a = 2; a < argc && numSizes < 32; a++)
+      sizes[numSizes++] = atoi(argv[a]);
+    benchmarkStrassen(sizes, numSizes, 3);
+    matrixStopThreads();
+    return 0;
+  }
+
+  if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    return benchMain(argc, argv);
+
+  // lab-1 dtypes [n ...]: bf16 / fp16 / int8 GEMM accuracy and speed vs f32
+  if (argc > 1 && strcmp(argv[1], "dtypes") == 0)
+  {
+    int sizes[32] = {256, 1024};
+    int numSizes = argc > 2 ? 0 : 2;
+    for (int a = 2; a < argc && numSizes < 32; a++)
+      sizes[numSizes++] = atoi(argv[a]);
+    reportDtypeAccuracy(sizes, numSizes, 3);
+    matrixStopThreads();
+    return 0;
+  }
+
+  // lab-1 sparse DENSITY [n ...]: CSR SpMV / SpMM vs dense GEMM
+  if (argc > 2 && strcmp(argv[1], "sparse") == 0)
+  {
+    int sizes[32] = {1024, 4096};
+    int numSizes = argc > 3 ? 0 : 2;
+    for (int a = 3; a < argc && numSizes < 32; a++)
+      sizes[numSizes++] = atoi(argv[a]);
+    reportSparse(sizes, numSizes, atof(argv[2]), 3);
+    matrixStopThreads();
+    return 0;
+  }
+
+  // lab-1 save ROWS COLS FILE: random matrix streamed out in row blocks
+  if (argc == 5 && strcmp(argv[1], "save") == 0)
+  {
+    int rows = atoi(argv[2]), cols = atoi(argv[3]);
+    int blockRows = cols > 0 && cols < (1 << 20) ? (1 << 20) / cols + 1 : 1;
+    MatrixWriter *writer = beginMatrixFile(argv[4], rows, cols);
+    Matrix_t *block = writer ? newMatrix(blockRows, cols) : NULL;
+    int status = block ? 0 : -1;
+    for (int i = 0; status == 0 && i < rows; i += blockRows)
+    {
+      Matrix_t part = matrixRowBlock(block, 0, rows - i < blockRows ? rows - i : blockRows);
+      makeMatrixRandom(&part);
+      status = writeMatrixRows(writer, &part);
+    }
+    if (writer && endMatrixFile(writer) != 0)
+      status = -1;
+    deleteMatrix(block);
+    matrixStopThreads();
+    return status == 0 ? 0 : EXIT_FAILURE;
+  }
+
+  // lab-1 load FILE: map a matrix file and reduce it
+  if (argc == 3 && strcmp(argv[1], "load") == 0)
+  {
+    double start = benchNow();
+    Matrix_t *matrix = loadMatrixMapped(argv[2]);
+    if (!matrix)
+      return EXIT_FAILURE;
+    double mapped = benchNow();
+    double mean = meanMatrix(matrix);
+    double done = benchNow();
+    printf("%dx%d  map %.3f ms  mean %.6f (%.3f ms, %.2f GB/s)\n", matrix->rows, matrix->cols,
+           (mapped - start) * 1e3, mean, (done - mapped) * 1e3,
+           (double)matrix->rows * matrix->cols * matrixDtypeSize(matrix->dtype) / (done - mapped) * 1e-9);
+    deleteMatrix(matrix);
+    matrixStopThreads();
+    return 0;
+  }
+
+  int numIterations = 10;
+
+  // Samples stream into the results file and the running statistics, so
+  // memory stays fixed however long the run is
+  StreamStats addStats, multStats;
+  streamStatsInit(&addStats, -2.0, 2.0, 40);    // mean of A + B, A and B in [-1, 1)
+  streamStatsInit(&multStats, -12.0, 12.0, 48); // sum of a 2x2 product of 3-term dots
+  ResultsWriter *results = beginResultsFile(outputFile, "add_mean mult_sum");
+  if (!results)
+    return EXIT_FAILURE;
+
+  // Every matrix of an iteration comes from here; the loop itself never
+  // touches the heap
+  MatrixArena *arena = newMatrixArena(4096);
+  if (!arena)
+  {
+    endResultsFile(results);
+    return EXIT_FAILURE;
+  }
+
+  int status = 0;
+  for (int i = 0; status == 0 && i < 1000; ++i)
+  {
+    resetMatrixArena(arena);
+    Matrix_t *A = newArenaMatrix(arena, 2, 3);
+    Matrix_t *B = newArenaMatrix(arena, 2, 3);
+    Matrix_t *E = newArenaMatrix(arena, 2, 3);
+    Matrix_t *F = newArenaMatrix(arena, 3, 2);
+    if (!A || !B || !E || !F)
+    {
+      fprintf(stderr, "Error: Failed to create matrices.\n");
+      status = -1;
+      break;
+    }
+
+    // mean(A + B) is fused into one pass; C is never materialized
+    MatrixExpr *C = exprAdd(arena, exprMatrix(arena, A), exprMatrix(arena, B));
+    // sum(E * F) as colsum(E) . rowsum(F); D is never materialized
+    MatrixExpr *D = exprMatmul(arena, exprMatrix(arena, E), exprMatrix(arena, F));
+    if (!C || !D)
+    {
+      fprintf(stderr, "Error: Failed to build the matrix expressions.\n");
+      status = -1;
+      break;
+    }
+
+    for (int t = 0; status == 0 && t < numIterations; t++)
+    {
+      makeMatrixRandom(A);
+      makeMatrixRandom(B);
+      makeMatrixRandom(E);
+      makeMatrixRandom(F);
+      double sample[2] = {exprMean(C), exprSum(D)};
+      streamStatsAdd(&addStats, sample[0]);
+      streamStatsAdd(&multStats, sample[1]);
+      status = writeResultsRow(results, sample, 2);
+    }
+  }
+
+  if (status == 0)
+    status = writeResultsStats(results, "Addition", &addStats);
+  if (status == 0)
+    status = writeResultsStats(results, "Multiplication", &multStats);
+  if (endResultsFile(results) != 0)
+    status = -1;
+  deleteMatrixArena(arena);
+  return status == 0 ? 0 : EXIT_FAILURE;
+}
@@ -1,7 +1,18 @@
 // WAP to implement MP Neuron
+//
+// Build: gcc -O3 lab-2.c -o lab-2 -lpthread
 
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 typedef struct MPNeuron
 {
@@ -81,91 +92,1638 @@ void set_weights(MPNeuron *neuron, const int *weights, int numWeights)
     neuron->weights[i] = weights[i];
 }
 
-int main()
+// Packed evaluation
+// Inputs that are only ever 0/1 are stored one bit each, input i in bit
+// i % 64 of word i / 64. The weights are split into bit planes of their
+// positive and negative parts, so that
+//   sum = sum over b of 2^b * (popcount(x & pos[b]) - popcount(x & neg[b]))
+// and a neuron with weights in {-1, 0, 1} costs two AND+POPCNT per 64 inputs.
+#define PACKED_WORDS(n) (((n) + 63) / 64)
+
+typedef struct PackedMPNeuron
 {
-  const int num_dimns = 3;
-  const int inputs[][3] = {
-      {0, 0, 0},
-      {0, 0, 1},
-      {0, 1, 0},
-      {0, 1, 1},
-      {1, 0, 0},
-      {1, 0, 1},
-      {1, 1, 0},
-      {1, 1, 1}};
-  const int num_samples = 1 << num_dimns;
-
-  // AND gate
-  printf("\n----- ----- ----- AND GATE ----- ----- -----\n");
-  MPNeuron *and_neuron = new_MPNeuron(num_dimns, num_dimns);
-  for (int i = 0; i < num_samples; i++)
+  int numInputs;
+  int numWords;
+  int numPlanes; // bit length of the largest |weight|
+  int threshold;
+  uint64_t *pos; // numPlanes x numWords
+  uint64_t *neg; // numPlanes x numWords
+  int *weights;  // for bit-sliced evaluation
+} PackedMPNeuron;
+
+static int popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ull);
+  x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+  return (int)((x * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+void delete_PackedMPNeuron(PackedMPNeuron *neuron)
+{
+  if (!neuron)
+    return;
+  free(neuron->pos);
+  free(neuron->neg);
+  free(neuron->weights);
+  free(neuron);
+}
+
+PackedMPNeuron *pack_MPNeuron(const MPNeuron *neuron)
+{
+  if (!neuron || !neuron->weights)
   {
-    int result = activate(and_neuron, inputs[i], num_dimns);
-    printf("Input: ");
-    for (int j = 0; j < num_dimns; j++)
-      printf("%d ", inputs[i][j]);
+    fprintf(stderr, "Invalid neuron\n");
+    return NULL;
+  }
 
-    printf("-> Output: %d\n", result);
+  PackedMPNeuron *packed = (PackedMPNeuron *)calloc(1, sizeof(PackedMPNeuron));
+  if (!packed)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
   }
-  delete_MPNeuron(and_neuron);
 
-  // OR gate
-  printf("\n----- ----- ----- OR GATE ----- ----- -----\n");
-  MPNeuron *or_neuron = new_MPNeuron(num_dimns, 1);
-  for (int i = 0; i < num_samples; i++)
+  int n = neuron->numWeights;
+  long long maxAbs = 0;
+  for (int i = 0; i < n; i++)
+  {
+    long long w = neuron->weights[i] < 0 ? -(long long)neuron->weights[i] : neuron->weights[i];
+    maxAbs = w > maxAbs ? w : maxAbs;
+  }
+  while (maxAbs >> packed->numPlanes)
+    packed->numPlanes++;
+
+  packed->numInputs = n;
+  packed->numWords = PACKED_WORDS(n);
+  packed->threshold = neuron->threshold;
+  size_t words = (size_t)packed->numPlanes * packed->numWords;
+  packed->pos = (uint64_t *)calloc(words ? words : 1, sizeof(uint64_t));
+  packed->neg = (uint64_t *)calloc(words ? words : 1, sizeof(uint64_t));
+  packed->weights = (int *)malloc((n ? n : 1) * sizeof(int));
+  if (!packed->pos || !packed->neg || !packed->weights)
+  {
+    fprintf(stderr, "Memory allocation for packed weights failed\n");
+    delete_PackedMPNeuron(packed);
+    return NULL;
+  }
+
+  for (int i = 0; i < n; i++)
+  {
+    int w = neuron->weights[i];
+    unsigned long long a = w < 0 ? -(long long)w : w;
+    uint64_t *planes = w < 0 ? packed->neg : packed->pos;
+    packed->weights[i] = w;
+    for (int b = 0; b < packed->numPlanes; b++)
+      if (a >> b & 1)
+        planes[(size_t)b * packed->numWords + i / 64] |= 1ull << (i % 64);
+  }
+  return packed;
+}
+
+// 0/1 ints to a bitset of PACKED_WORDS(numInputs) words
+void pack_inputs(const int *inputs, int numInputs, uint64_t *bits)
+{
+  for (int w = 0; w < PACKED_WORDS(numInputs); w++)
+    bits[w] = 0;
+  for (int i = 0; i < numInputs; i++)
+    if (inputs[i])
+      bits[i / 64] |= 1ull << (i % 64);
+}
+
+int activate_packed(const PackedMPNeuron *neuron, const uint64_t *inputs)
+{
+  if (!neuron || !inputs)
+  {
+    fprintf(stderr, "Invalid neuron OR inputs\n");
+    return -1; // Error code
+  }
+
+  long long sum = 0;
+  for (int b = 0; b < neuron->numPlanes; b++)
+  {
+    const uint64_t *pos = neuron->pos + (size_t)b * neuron->numWords;
+    const uint64_t *neg = neuron->neg + (size_t)b * neuron->numWords;
+    long long plane = 0;
+    for (int w = 0; w < neuron->numWords; w++)
+      plane += popcount64(inputs[w] & pos[w]) - popcount64(inputs[w] & neg[w]);
+    sum += plane * (1LL << b); // plane may be negative, so no shift
+  }
+
+  return sum >= neuron->threshold ? 1 : 0;
+}
+
+// Bit-sliced evaluation
+// Many input vectors at once, one per bit lane: slice i holds input i of
+// 64 samples per word. A negative weight turns w * x into |w| * (1 - x) - |w|,
+// so the neuron fires iff sum of |w_i| * y_i >= threshold + negSum with y_i
+// = x_i or NOT x_i. That unsigned sum is accumulated per lane in bit planes
+// with a ripple-carry adder and compared to the constant at the end. Blocks
+// of SLICE_WORDS words (512 lanes, one AVX-512 register per plane) are the
+// unit of work.
+#define SLICE_WORDS 8
+#define SLICE_MAX_PLANES 64
+
+// One neuron as the kernels see it: input i is slice sources[i] (slice i
+// when sources is NULL) of a block of slices
+typedef struct SliceOp
+{
+  int numInputs;
+  const int *weights;
+  const int *sources;
+  int threshold;
+  int planes; // bit planes needed for sums up to absSum
+  long long negSum;
+  long long absSum;
+} SliceOp;
+
+static SliceOp slice_op(int numInputs, const int *weights, const int *sources, int threshold)
+{
+  SliceOp op = {numInputs, weights, sources, threshold, 0, 0, 0};
+  for (int i = 0; i < numInputs; i++)
+  {
+    long long w = weights[i] < 0 ? -(long long)weights[i] : weights[i];
+    op.absSum += w;
+    if (weights[i] < 0)
+      op.negSum += w;
+  }
+  while (op.planes < SLICE_MAX_PLANES && op.absSum >> op.planes)
+    op.planes++;
+  return op;
+}
+
+// Portable version, for any number of words up to SLICE_WORDS
+static void sliced_generic(const SliceOp *neuron, const uint64_t *slices, size_t stride,
+                           uint64_t *outputs, int words)
+{
+  uint64_t acc[SLICE_MAX_PLANES][SLICE_WORDS];
+  int planes = neuron->planes;
+  for (int b = 0; b < planes; b++)
+    for (int k = 0; k < words; k++)
+      acc[b][k] = 0;
+
+  for (int i = 0; i < neuron->numInputs; i++)
+  {
+    int w = neuron->weights[i];
+    if (!w)
+      continue;
+    unsigned long long a = w < 0 ? -(long long)w : w;
+    uint64_t flip = w < 0 ? ~0ull : 0;
+    const uint64_t *x = slices + (size_t)(neuron->sources ? neuron->sources[i] : i) * stride;
+    uint64_t carry[SLICE_WORDS], any = 1;
+    for (int k = 0; k < words; k++)
+      carry[k] = 0;
+
+    // Stop once the weight's bits are used up and no lane carries
+    for (int b = 0; b < planes && (any || a >> b); b++)
+    {
+      any = 0;
+      for (int k = 0; k < words; k++)
+      {
+        uint64_t y = a >> b & 1 ? x[k] ^ flip : 0, s = acc[b][k], t = s ^ y;
+        acc[b][k] = t ^ carry[k];
+        carry[k] = (s & y) | (carry[k] & t);
+        any |= carry[k];
+      }
+    }
+  }
+
+  long long target = (long long)neuron->threshold + neuron->negSum;
+  for (int k = 0; k < words; k++)
+  {
+    if (target <= 0 || target > neuron->absSum)
+    {
+      outputs[k] = target <= 0 ? ~0ull : 0;
+      continue;
+    }
+    uint64_t gt = 0, eq = ~0ull;
+    for (int b = planes - 1; b >= 0; b--)
+    {
+      if (target >> b & 1)
+        eq &= acc[b][k];
+      else
+      {
+        gt |= eq & acc[b][k];
+        eq &= ~acc[b][k];
+      }
+    }
+    outputs[k] = gt | eq;
+  }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MP_X86_KERNELS 1
+#include <immintrin.h>
+
+// One 512-lane block; ternary logic does the full adder in two ops
+// (0x96 = a ^ b ^ c, 0xE8 = majority)
+__attribute__((target("avx512f"))) static void sliced_avx512(const SliceOp *neuron, const uint64_t *slices,
+                                                             size_t stride, uint64_t *outputs, int words)
+{
+  (void)words;
+  __m512i acc[SLICE_MAX_PLANES];
+  int planes = neuron->planes;
+  for (int b = 0; b < planes; b++)
+    acc[b] = _mm512_setzero_si512();
+
+  for (int i = 0; i < neuron->numInputs; i++)
+  {
+    int w = neuron->weights[i];
+    if (!w)
+      continue;
+    unsigned long long a = w < 0 ? -(long long)w : w;
+    const uint64_t *x = slices + (size_t)(neuron->sources ? neuron->sources[i] : i) * stride;
+    __m512i y = _mm512_loadu_si512((const void *)x);
+    if (w < 0)
+      y = _mm512_ternarylogic_epi64(y, y, y, 0x55); // NOT
+    __m512i carry = _mm512_setzero_si512();
+    for (int b = 0; b < planes; b++)
+    {
+      __m512i s = acc[b];
+      if (a >> b & 1)
+      {
+        acc[b] = _mm512_ternarylogic_epi64(s, y, carry, 0x96);
+        carry = _mm512_ternarylogic_epi64(s, y, carry, 0xE8);
+      }
+      else
+      {
+        acc[b] = _mm512_xor_si512(s, carry);
+        carry = _mm512_and_si512(s, carry);
+      }
+      if (!(a >> b >> 1) && !_mm512_test_epi64_mask(carry, carry))
+        break;
+    }
+  }
+
+  long long target = (long long)neuron->threshold + neuron->negSum;
+  __m512i out;
+  if (target <= 0 || target > neuron->absSum)
+    out = _mm512_set1_epi64(target <= 0 ? -1 : 0);
+  else
+  {
+    __m512i gt = _mm512_setzero_si512(), eq = _mm512_set1_epi64(-1);
+    for (int b = planes - 1; b >= 0; b--)
+    {
+      if (target >> b & 1)
+        eq = _mm512_and_si512(eq, acc[b]);
+      else
+      {
+        gt = _mm512_or_si512(gt, _mm512_and_si512(eq, acc[b]));
+        eq = _mm512_andnot_si512(acc[b], eq);
+      }
+    }
+    out = _mm512_or_si512(gt, eq);
+  }
+  _mm512_storeu_si512((void *)outputs, out);
+}
+#endif
+
+typedef void (*SlicedFn)(const SliceOp *, const uint64_t *, size_t, uint64_t *, int);
+
+static SlicedFn sliced_kernel(void)
+{
+  static SlicedFn fn = NULL;
+  if (fn)
+    return fn;
+  fn = sliced_generic;
+#ifdef MP_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    fn = sliced_avx512;
+#endif
+  return fn;
+}
+
+// slices[i * numWords + w]: bit k is input i of sample 64 * w + k.
+// outputs[w]: bit k is the neuron's output for that sample.
+int activate_sliced(const PackedMPNeuron *neuron, const uint64_t *slices, size_t numWords, uint64_t *outputs)
+{
+  if (!neuron || !slices || !outputs)
+  {
+    fprintf(stderr, "Invalid neuron OR inputs\n");
+    return -1; // Error code
+  }
+
+  SliceOp op = slice_op(neuron->numInputs, neuron->weights, NULL, neuron->threshold);
+  SlicedFn fn = sliced_kernel();
+  size_t w = 0;
+  for (; w + SLICE_WORDS <= numWords; w += SLICE_WORDS)
+    fn(&op, slices + w, numWords, outputs + w, SLICE_WORDS);
+  if (w < numWords)
+    sliced_generic(&op, slices + w, numWords, outputs + w, (int)(numWords - w));
+  return 0;
+}
+
+// Slices for the consecutive samples first, first + 1, ... (first a multiple
+// of 64): input i of sample s is bit i of s
+void counter_slices(uint64_t first, int numInputs, uint64_t *slices, size_t numWords)
+{
+  static const uint64_t lowBits[6] = {0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+                                      0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull};
+  for (int i = 0; i < numInputs; i++)
+    for (size_t w = 0; w < numWords; w++)
+      slices[(size_t)i * numWords + w] = i < 6 ? lowBits[i] : ((first >> 6) + w) >> (i - 6) & 1 ? ~0ull : 0;
+}
+
+// Number of the 2^numInputs input vectors for which the neuron fires
+long long count_ones_sliced(const PackedMPNeuron *neuron)
+{
+  int n = neuron->numInputs;
+  if (n > 62)
+  {
+    fprintf(stderr, "Too many inputs for exhaustive evaluation\n");
+    return -1;
+  }
+
+  uint64_t *slices = (uint64_t *)malloc(((size_t)n + 1) * SLICE_WORDS * sizeof(uint64_t));
+  if (!slices)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+
+  uint64_t total = 1ull << n, outputs[SLICE_WORDS];
+  long long ones = 0;
+  for (uint64_t first = 0; first < total; first += 64 * SLICE_WORDS)
+  {
+    size_t words = total - first >= 64 * SLICE_WORDS ? SLICE_WORDS : (size_t)((total - first + 63) / 64);
+    counter_slices(first, n, slices, words);
+    activate_sliced(neuron, slices, words, outputs);
+    for (size_t w = 0; w < words; w++)
+    {
+      uint64_t valid = total - first - 64 * w >= 64 ? ~0ull : (1ull << (total - first - 64 * w)) - 1;
+      ones += popcount64(outputs[w] & valid);
+    }
+  }
+  free(slices);
+  return ones;
+}
+
+// Truth tables
+// All 2^n inputs of a neuron, enumerated on the fly: input vector x has
+// input i in bit i, and its output is bit x of the table. The low
+// TRUTH_LOW_BITS inputs pick a bit inside one 64-bit word. Their 64 partial
+// sums are sorted once, so the word for a given sum of the high inputs
+// (base) is a prefix mask: the outputs of every partial sum that reaches
+// threshold - base, found by binary search. The high inputs are walked in
+// Gray-code order, so base changes by one weight from one word to the next.
+// Threads take contiguous ranges of Gray-code ranks and each word is written
+// by exactly one of them.
+#define TRUTH_LOW_BITS 6
+#define TRUTH_MAX_INPUTS 36
+#define TRUTH_MAX_THREADS 64
+
+typedef struct TruthTable
+{
+  int numInputs;
+  uint64_t numWords;
+  uint64_t *bits; // bit x of the table is bits[x / 64] >> (x % 64) & 1
+  uint64_t ones;  // number of inputs for which the neuron fires
+} TruthTable;
+
+typedef struct TruthTableJob
+{
+  const MPNeuron *neuron;
+  TruthTable *table;
+  int lowInputs;          // inputs inside a word, min(n, TRUTH_LOW_BITS)
+  int lowCount;           // 2^lowInputs
+  long long lowSums[64];  // partial sums of the low inputs, descending
+  uint64_t lowMasks[65];  // lowMasks[r]: bits of the r largest partial sums
+} TruthTableJob;
+
+typedef struct TruthTableWorker
+{
+  const TruthTableJob *job;
+  uint64_t begin, end; // Gray-code ranks of words
+  uint64_t ones;
+} TruthTableWorker;
+
+static int count_trailing_zeros(uint64_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1))
+  {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static int hardware_threads(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+static void *truth_table_worker(void *arg)
+{
+  TruthTableWorker *worker = (TruthTableWorker *)arg;
+  const TruthTableJob *job = worker->job;
+  const int *high = job->neuron->weights + job->lowInputs;
+  uint64_t *bits = job->table->bits;
+  int threshold = job->neuron->threshold;
+
+  // The word at rank r holds inputs with high part gray(r) = r ^ (r >> 1)
+  uint64_t gray = worker->begin ^ (worker->begin >> 1);
+  long long base = 0;
+  for (int i = 0; i < job->neuron->numWeights - job->lowInputs; i++)
+    if (gray >> i & 1)
+      base += high[i];
+
+  uint64_t ones = 0;
+  for (uint64_t r = worker->begin; r < worker->end; r++)
+  {
+    long long need = threshold - base;
+    int lo = 0, hi = job->lowCount;
+    while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (job->lowSums[mid] >= need)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    bits[gray] = job->lowMasks[lo];
+    ones += popcount64(job->lowMasks[lo]);
+
+    if (r + 1 < worker->end)
+    {
+      int flip = count_trailing_zeros(r + 1);
+      gray ^= 1ull << flip;
+      base += gray >> flip & 1 ? high[flip] : -high[flip];
+    }
+  }
+  worker->ones = ones;
+  return NULL;
+}
+
+void delete_TruthTable(TruthTable *table)
+{
+  if (!table)
+    return;
+  free(table->bits);
+  free(table);
+}
+
+// numThreads <= 0 uses every hardware thread
+TruthTable *new_TruthTable(const MPNeuron *neuron, int numThreads)
+{
+  if (!neuron || !neuron->weights)
+  {
+    fprintf(stderr, "Invalid neuron\n");
+    return NULL;
+  }
+  int n = neuron->numWeights;
+  if (n < 0 || n > TRUTH_MAX_INPUTS)
+  {
+    fprintf(stderr, "Truth tables support up to %d inputs, got %d\n", TRUTH_MAX_INPUTS, n);
+    return NULL;
+  }
+
+  TruthTable *table = (TruthTable *)calloc(1, sizeof(TruthTable));
+  TruthTableJob *job = (TruthTableJob *)malloc(sizeof(TruthTableJob));
+  int low = n < TRUTH_LOW_BITS ? n : TRUTH_LOW_BITS;
+  uint64_t numWords = 1ull << (n - low);
+  if (table)
+    table->bits = (uint64_t *)malloc(numWords * sizeof(uint64_t));
+  if (!table || !job || !table->bits)
+  {
+    fprintf(stderr, "Memory allocation for truth table failed\n");
+    delete_TruthTable(table);
+    free(job);
+    return NULL;
+  }
+  table->numInputs = n;
+  table->numWords = numWords;
+
+  // Partial sums of the low inputs, sorted descending with their bit
+  job->neuron = neuron;
+  job->table = table;
+  job->lowInputs = low;
+  job->lowCount = 1 << low;
+  int order[64];
+  for (int x = 0; x < job->lowCount; x++)
+  {
+    long long sum = 0;
+    for (int i = 0; i < low; i++)
+      if (x >> i & 1)
+        sum += neuron->weights[i];
+    int at = x;
+    while (at > 0 && job->lowSums[at - 1] < sum)
+    {
+      job->lowSums[at] = job->lowSums[at - 1];
+      order[at] = order[at - 1];
+      at--;
+    }
+    job->lowSums[at] = sum;
+    order[at] = x;
+  }
+  job->lowMasks[0] = 0;
+  for (int r = 0; r < job->lowCount; r++)
+    job->lowMasks[r + 1] = job->lowMasks[r] | 1ull << order[r];
+
+  if (numThreads <= 0)
+    numThreads = hardware_threads();
+  if (numThreads > TRUTH_MAX_THREADS)
+    numThreads = TRUTH_MAX_THREADS;
+  if ((uint64_t)numThreads > numWords / 1024 + 1)
+    numThreads = (int)(numWords / 1024 + 1);
+
+  TruthTableWorker workers[TRUTH_MAX_THREADS];
+  pthread_t threads[TRUTH_MAX_THREADS];
+  int started = 1;
+  for (int t = 0; t < numThreads; t++)
+  {
+    workers[t].job = job;
+    workers[t].begin = numWords / numThreads * t;
+    workers[t].end = t + 1 == numThreads ? numWords : numWords / numThreads * (t + 1);
+    workers[t].ones = 0;
+  }
+  // Thread 0's range runs on the calling thread; a failed start runs inline
+  for (int t = 1; t < numThreads; t++, started++)
+    if (pthread_create(&threads[t], NULL, truth_table_worker, &workers[t]) != 0)
+      break;
+  truth_table_worker(&workers[0]);
+  for (int t = 1; t < numThreads; t++)
+  {
+    if (t < started)
+      pthread_join(threads[t], NULL);
+    else
+      truth_table_worker(&workers[t]);
+    workers[0].ones += workers[t].ones;
+  }
+
+  table->ones = workers[0].ones;
+  free(job);
+  return table;
+}
+
+// Output for one input vector (input i in bit i)
+int truth_table_output(const TruthTable *table, uint64_t input)
+{
+  return (int)(table->bits[input / 64] >> (input % 64) & 1);
+}
+
+// Table of the given bits (2^numInputs of them, input x at bit x)
+TruthTable *new_TruthTable_from_bits(int numInputs, const uint64_t *bits)
+{
+  if (numInputs < 0 || numInputs > TRUTH_MAX_INPUTS || !bits)
+  {
+    fprintf(stderr, "Invalid truth table bits\n");
+    return NULL;
+  }
+  TruthTable *table = (TruthTable *)calloc(1, sizeof(TruthTable));
+  uint64_t numWords = numInputs < TRUTH_LOW_BITS ? 1 : 1ull << (numInputs - TRUTH_LOW_BITS);
+  if (table)
+    table->bits = (uint64_t *)malloc(numWords * sizeof(uint64_t));
+  if (!table || !table->bits)
+  {
+    fprintf(stderr, "Memory allocation for truth table failed\n");
+    delete_TruthTable(table);
+    return NULL;
+  }
+  table->numInputs = numInputs;
+  table->numWords = numWords;
+  for (uint64_t w = 0; w < numWords; w++)
+  {
+    table->bits[w] = bits[w];
+    if (numInputs < TRUTH_LOW_BITS)
+      table->bits[w] &= (1ull << (1 << numInputs)) - 1;
+    table->ones += popcount64(table->bits[w]);
+  }
+  return table;
+}
+
+// Synthesis
+// Finds integer weights with |w| <= maxWeight and a threshold that realize
+// a target truth table. Every threshold function is unate, so each input
+// either never lowers the output, never raises it, or is irrelevant. That
+// fixes the sign of its weight, and irrelevant inputs get 0. Inputs of the
+// negative kind are flipped so the search only sees positive weights.
+// Every threshold function is also 2-monotonic: of any two inputs, one helps
+// at least as much as the other everywhere. Any realization orders the two
+// weights that way, and a tie means the inputs are symmetric and can be
+// swapped. So the search only walks non-increasing weight vectors, largest
+// first. A function failing either test has no realization at any bound.
+//
+// With the first k weights fixed, each assignment s of the remaining inputs
+// picks a block of 2^k table entries. The prefix sums must already separate
+// every block: maxFalse_s < minTrue_s. The remaining inputs add between |s|
+// and |s| * w[k-1], so the threshold must also lie in
+// [maxFalse_s + 1 + |s|, minTrue_s + |s| * w[k-1]] for every s. A prefix
+// failing either test is dropped, at the first block that fails it.
+//
+// Candidates go in order of their largest weight, so the first one found
+// has the smallest. Threads take (largest, second largest) weight pairs in
+// that order. The lowest pair with a solution wins, whatever the thread count.
+#define SYNTH_MAX_INPUTS 16
+
+typedef enum SynthesisStatus
+{
+  SYNTH_FOUND,
+  SYNTH_NOT_THRESHOLD, // not unate or not 2-monotonic: no weights at all
+  SYNTH_NO_WEIGHTS,    // no weights within the bound
+  SYNTH_ERROR = -1
+} SynthesisStatus;
+
+typedef struct SynthesisJob
+{
+  int numVars;                  // relevant inputs, largest weight first
+  int maxWeight;
+  int strict[SYNTH_MAX_INPUTS]; // weight j must exceed weight j + 1
+  const int *target;            // 2^numVars outputs as 0 / -1, variable j in bit j
+  pthread_mutex_t lock;
+  int nextTop, nextSecond;
+  long long nextTask;
+  long long bestTask; // lowest task with a solution, -1 if none yet
+  int bestWeights[SYNTH_MAX_INPUTS];
+  int bestThreshold;
+} SynthesisJob;
+
+typedef struct SynthesisWorker
+{
+  SynthesisJob *job;
+  int weights[SYNTH_MAX_INPUTS];
+  int *sums; // the 2^k prefix sums over weights[0 .. k-1] are at sums + 2^k
+  int threshold;
+} SynthesisWorker;
+
+// Build the sums of weights[0 .. k-1] and test the prefix; at k == numVars
+// a pass also sets the threshold
+static int synthesis_extend(SynthesisWorker *worker, int k)
+{
+  const SynthesisJob *job = worker->job;
+  int half = 1 << (k - 1), blockSize = 1 << k;
+  const int *prev = worker->sums + half;
+  int *sums = worker->sums + blockSize;
+  for (int p = 0; p < half; p++)
+  {
+    sums[p] = prev[p];
+    sums[half + p] = prev[p] + worker->weights[k - 1];
+  }
+
+  long long maxRest = worker->weights[k - 1] - job->strict[k - 1];
+  long long lower = LLONG_MIN, upper = LLONG_MAX;
+  int numBlocks = 1 << (job->numVars - k);
+  for (int s = 0; s < numBlocks; s++)
+  {
+    const int *block = job->target + (size_t)s * blockSize;
+    int maxFalse = INT_MIN, minTrue = INT_MAX;
+    for (int p = 0; p < blockSize; p++)
+    {
+      // Branch-free so it vectorizes: true entries offer INT_MIN to
+      // maxFalse, false entries INT_MAX to minTrue
+      int asFalse = (sums[p] & ~block[p]) | (INT_MIN & block[p]);
+      int asTrue = (sums[p] & block[p]) | (INT_MAX & ~block[p]);
+      maxFalse = asFalse > maxFalse ? asFalse : maxFalse;
+      minTrue = asTrue < minTrue ? asTrue : minTrue;
+    }
+    if (maxFalse >= minTrue)
+      return 0;
+
+    int rest = popcount64((uint64_t)s);
+    if (maxFalse != INT_MIN && maxFalse + 1LL + rest > lower)
+      lower = maxFalse + 1LL + rest;
+    if (minTrue != INT_MAX && minTrue + rest * maxRest < upper)
+      upper = minTrue + rest * maxRest;
+    if (lower > upper)
+      return 0;
+  }
+  worker->threshold = (int)(upper != LLONG_MAX ? upper : lower);
+  return 1;
+}
+
+static int synthesis_search(SynthesisWorker *worker, int k)
+{
+  if (!synthesis_extend(worker, k))
+    return 0;
+  if (k == worker->job->numVars)
+    return 1;
+  int maxNext = worker->weights[k - 1] - worker->job->strict[k - 1];
+  for (int w = 1; w <= maxNext; w++)
+  {
+    worker->weights[k] = w;
+    if (synthesis_search(worker, k + 1))
+      return 1;
+  }
+  return 0;
+}
+
+static void *synthesis_worker(void *arg)
+{
+  SynthesisWorker *worker = (SynthesisWorker *)arg;
+  SynthesisJob *job = worker->job;
+  int numVars = job->numVars;
+  worker->sums[1] = 0;
+  for (;;)
+  {
+    // Next (largest, second largest) pair; tops too small for a second
+    // weight below them are skipped
+    pthread_mutex_lock(&job->lock);
+    while (numVars > 1 && job->nextTop <= job->maxWeight && job->nextSecond > job->nextTop - job->strict[0])
+    {
+      job->nextTop++;
+      job->nextSecond = 1;
+    }
+    if (job->nextTop > job->maxWeight || (job->bestTask >= 0 && job->nextTask > job->bestTask))
+    {
+      pthread_mutex_unlock(&job->lock);
+      return NULL;
+    }
+    long long task = job->nextTask++;
+    int top = job->nextTop, second = job->nextSecond;
+    if (numVars > 1)
+      job->nextSecond++;
+    else
+      job->nextTop++;
+    pthread_mutex_unlock(&job->lock);
+
+    worker->weights[0] = top;
+    int found;
+    if (numVars == 1)
+      found = synthesis_search(worker, 1);
+    else
+    {
+      found = synthesis_extend(worker, 1);
+      worker->weights[1] = second;
+      found = found && synthesis_search(worker, 2);
+    }
+
+    if (found)
+    {
+      pthread_mutex_lock(&job->lock);
+      if (job->bestTask < 0 || task < job->bestTask)
+      {
+        job->bestTask = task;
+        for (int j = 0; j < numVars; j++)
+          job->bestWeights[j] = worker->weights[j];
+        job->bestThreshold = worker->threshold;
+      }
+      pthread_mutex_unlock(&job->lock);
+    }
+  }
+}
+
+// Output of the target with the inputs in flip toggled
+static int synthesis_output(const TruthTable *target, uint64_t input, uint64_t flip)
+{
+  return truth_table_output(target, input ^ flip);
+}
+
+// numThreads <= 0 uses every hardware thread. On SYNTH_FOUND *result is a
+// new neuron with the smallest largest |weight| that realizes target.
+SynthesisStatus synthesize_MPNeuron(const TruthTable *target, int maxWeight, int numThreads, MPNeuron **result)
+{
+  if (!target || !target->bits || !result || maxWeight < 1 || maxWeight > 1 << 24)
+  {
+    fprintf(stderr, "Invalid synthesis target OR bound\n");
+    return SYNTH_ERROR;
+  }
+  int n = target->numInputs;
+  if (n > SYNTH_MAX_INPUTS)
+  {
+    fprintf(stderr, "Synthesis supports up to %d inputs, got %d\n", SYNTH_MAX_INPUTS, n);
+    return SYNTH_ERROR;
+  }
+  *result = NULL;
+  uint64_t size = 1ull << n;
+
+  // Unateness: the sign of each weight, 0 for irrelevant inputs
+  int sign[SYNTH_MAX_INPUTS];
+  uint64_t flip = 0;
+  int vars[SYNTH_MAX_INPUTS], numVars = 0;
+  for (int i = 0; i < n; i++)
+  {
+    int up = 1, down = 1;
+    for (uint64_t x = 0; x < size && (up || down); x++)
+      if (!(x >> i & 1))
+      {
+        int lo = truth_table_output(target, x), hi = truth_table_output(target, x | 1ull << i);
+        up &= lo <= hi;
+        down &= lo >= hi;
+      }
+    if (!up && !down)
+      return SYNTH_NOT_THRESHOLD;
+    sign[i] = up && down ? 0 : up ? 1 : -1;
+    if (sign[i] < 0)
+      flip |= 1ull << i;
+    if (sign[i])
+      vars[numVars++] = i;
+  }
+
+  // 2-monotonicity: geq[a][b] when setting input a never helps less than b
+  int geq[SYNTH_MAX_INPUTS][SYNTH_MAX_INPUTS], rank[SYNTH_MAX_INPUTS];
+  for (int a = 0; a < numVars; a++)
+    for (int b = 0; b < numVars; b++)
+    {
+      uint64_t ea = 1ull << vars[a], eb = 1ull << vars[b];
+      geq[a][b] = 1;
+      for (uint64_t x = 0; x < size && geq[a][b]; x++)
+        if (!(x & (ea | eb)))
+          geq[a][b] = synthesis_output(target, x | ea, flip) >= synthesis_output(target, x | eb, flip);
+    }
+  for (int a = 0; a < numVars; a++)
+  {
+    rank[a] = 0;
+    for (int b = 0; b < numVars; b++)
+    {
+      if (!geq[a][b] && !geq[b][a])
+        return SYNTH_NOT_THRESHOLD;
+      rank[a] += geq[a][b];
+    }
+  }
+  int order[SYNTH_MAX_INPUTS]; // positions into vars, largest weight first
+  for (int a = 0; a < numVars; a++)
+  {
+    int at = a;
+    while (at > 0 && rank[order[at - 1]] < rank[a])
+    {
+      order[at] = order[at - 1];
+      at--;
+    }
+    order[at] = a;
+  }
+
+  SynthesisJob job;
+  job.numVars = numVars;
+  job.maxWeight = maxWeight;
+  for (int j = 0; j + 1 < numVars; j++)
+  {
+    if (!geq[order[j]][order[j + 1]])
+      return SYNTH_NOT_THRESHOLD; // the order is not transitive
+    job.strict[j] = !geq[order[j + 1]][order[j]];
+  }
+  if (numVars > 0)
+    job.strict[numVars - 1] = 0;
+
+  if (numVars == 0)
+  {
+    // Constant output
+    *result = new_MPNeuron(n, truth_table_output(target, 0) ? 0 : 1);
+    if (!*result)
+      return SYNTH_ERROR;
+    for (int i = 0; i < n; i++)
+      (*result)->weights[i] = 0;
+    return SYNTH_FOUND;
+  }
+
+  // The flipped target over the relevant inputs, variable j in bit j
+  int *reduced = (int *)malloc(((size_t)1 << numVars) * sizeof(int));
+  if (!reduced)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return SYNTH_ERROR;
+  }
+  for (uint64_t y = 0; y < 1ull << numVars; y++)
+  {
+    uint64_t x = 0;
+    for (int j = 0; j < numVars; j++)
+      if (y >> j & 1)
+        x |= 1ull << vars[order[j]];
+    reduced[y] = -synthesis_output(target, x, flip);
+  }
+  job.target = reduced;
+  job.nextTop = 1;
+  job.nextSecond = 1;
+  job.nextTask = 0;
+  job.bestTask = -1;
+
+  if (numThreads <= 0)
+    numThreads = hardware_threads();
+  if (numThreads > TRUTH_MAX_THREADS)
+    numThreads = TRUTH_MAX_THREADS;
+  SynthesisWorker workers[TRUTH_MAX_THREADS];
+  pthread_t threads[TRUTH_MAX_THREADS];
+  int *sums = (int *)malloc((size_t)numThreads * ((size_t)2 << numVars) * sizeof(int));
+  if (!sums)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    free(reduced);
+    return SYNTH_ERROR;
+  }
+  pthread_mutex_init(&job.lock, NULL);
+  for (int t = 0; t < numThreads; t++)
+  {
+    workers[t].job = &job;
+    workers[t].sums = sums + (size_t)t * ((size_t)2 << numVars);
+  }
+  // Workers pull tasks, so one that fails to start is simply not needed
+  int started = 1;
+  for (int t = 1; t < numThreads; t++, started++)
+    if (pthread_create(&threads[t], NULL, synthesis_worker, &workers[t]) != 0)
+      break;
+  synthesis_worker(&workers[0]);
+  for (int t = 1; t < started; t++)
+    pthread_join(threads[t], NULL);
+  pthread_mutex_destroy(&job.lock);
+  free(sums);
+  free(reduced);
+
+  if (job.bestTask < 0)
+    return SYNTH_NO_WEIGHTS;
+
+  // Undo the flips: w (1 - x) >= ... becomes -w x with the threshold
+  // lowered by w
+  int threshold = job.bestThreshold;
+  for (int j = 0; j < numVars; j++)
+    if (sign[vars[order[j]]] < 0)
+      threshold -= job.bestWeights[j];
+  *result = new_MPNeuron(n, threshold);
+  if (!*result)
+    return SYNTH_ERROR;
+  for (int i = 0; i < n; i++)
+    (*result)->weights[i] = 0;
+  for (int j = 0; j < numVars; j++)
+    (*result)->weights[vars[order[j]]] = sign[vars[order[j]]] * job.bestWeights[j];
+  return SYNTH_FOUND;
+}
+
+// Networks
+// A network wires neurons to signals: signals 0 .. numInputs - 1 are the
+// network inputs and each added neuron drives one new signal. A neuron may
+// read signals that are only added later. compile_network keeps the neurons
+// the outputs depend on, orders them with Kahn's algorithm (rejecting
+// cycles) and lays them out as one instruction array over flat weight and
+// source arrays. Instructions read and write slots of a scratch block;
+// a slot is reused once the last reader of its signal has run, so a block's
+// working set stays small however many neurons the network has.
+typedef struct MPNetwork
+{
+  int numInputs;
+  int numNeurons;
+  int neuronCapacity;
+  int *thresholds;
+  int *first; // neuron k reads weights/sources [first[k], first[k] + fanIn[k])
+  int *fanIn;
+  int numEdges;
+  int edgeCapacity;
+  int *weights;
+  int *sources; // signal read by each weight
+  int numOutputs;
+  int *outputs;
+} MPNetwork;
+
+typedef struct MPInstruction
+{
+  SliceOp op; // sources are scratch slots
+  int dest;   // slot written
+} MPInstruction;
+
+typedef struct MPProgram
+{
+  int numInputs;
+  int numOutputs;
+  int numSlots;
+  int numInstructions;
+  int depth; // neurons on the longest input-to-output path
+  MPInstruction *code;
+  int *weights; // in instruction order
+  int *sources;
+  int *outputs; // slot of each output
+} MPProgram;
+
+MPNetwork *new_MPNetwork(int numInputs)
+{
+  if (numInputs < 0)
+  {
+    fprintf(stderr, "Invalid number of network inputs\n");
+    return NULL;
+  }
+  MPNetwork *net = (MPNetwork *)calloc(1, sizeof(MPNetwork));
+  if (!net)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+  net->numInputs = numInputs;
+  return net;
+}
+
+void delete_MPNetwork(MPNetwork *net)
+{
+  if (!net)
+    return;
+  free(net->thresholds);
+  free(net->first);
+  free(net->fanIn);
+  free(net->weights);
+  free(net->sources);
+  free(net->outputs);
+  free(net);
+}
+
+// Grow *array to hold at least needed ints, doubling from capacity
+static int grow_ints(int **array, int capacity, int needed)
+{
+  int newCapacity = capacity ? capacity : 16;
+  while (newCapacity < needed)
+    newCapacity *= 2;
+  int *grown = (int *)realloc(*array, (size_t)newCapacity * sizeof(int));
+  if (!grown)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+  *array = grown;
+  return newCapacity;
+}
+
+// Add a neuron reading sources[i] through weight i; returns its signal
+int network_add_neuron(MPNetwork *net, const MPNeuron *neuron, const int *sources)
+{
+  if (!net || !neuron || !neuron->weights || !sources)
+  {
+    fprintf(stderr, "Invalid network OR neuron\n");
+    return -1;
+  }
+  for (int i = 0; i < neuron->numWeights; i++)
+    if (sources[i] < 0)
+    {
+      fprintf(stderr, "Invalid source signal %d\n", sources[i]);
+      return -1;
+    }
+
+  if (net->numNeurons == net->neuronCapacity)
+  {
+    int needed = net->numNeurons + 1, capacity = -1;
+    if ((capacity = grow_ints(&net->thresholds, net->neuronCapacity, needed)) < 0 ||
+        grow_ints(&net->first, net->neuronCapacity, needed) < 0 ||
+        grow_ints(&net->fanIn, net->neuronCapacity, needed) < 0)
+      return -1;
+    net->neuronCapacity = capacity;
+  }
+  if (net->numEdges + neuron->numWeights > net->edgeCapacity)
+  {
+    int needed = net->numEdges + neuron->numWeights, capacity = -1;
+    if ((capacity = grow_ints(&net->weights, net->edgeCapacity, needed)) < 0 ||
+        grow_ints(&net->sources, net->edgeCapacity, needed) < 0)
+      return -1;
+    net->edgeCapacity = capacity;
+  }
+
+  int k = net->numNeurons++;
+  net->thresholds[k] = neuron->threshold;
+  net->first[k] = net->numEdges;
+  net->fanIn[k] = neuron->numWeights;
+  for (int i = 0; i < neuron->numWeights; i++)
+  {
+    net->weights[net->numEdges] = neuron->weights[i];
+    net->sources[net->numEdges++] = sources[i];
+  }
+  return net->numInputs + k;
+}
+
+// Add a layer of neurons that all read the same numSources signals;
+// returns the signal of the first, the rest follow consecutively
+int network_add_layer(MPNetwork *net, MPNeuron *const *neurons, int count, const int *sources, int numSources)
+{
+  if (!net || !neurons || !sources || count < 0 || numSources < 0)
+  {
+    fprintf(stderr, "Invalid network OR neuron\n");
+    return -1;
+  }
+
+  int firstSignal = net->numInputs + net->numNeurons;
+  for (int j = 0; j < count; j++)
+  {
+    if (!neurons[j] || neurons[j]->numWeights != numSources)
+    {
+      fprintf(stderr, "Layer neuron %d must have %d weights\n", j, numSources);
+      return -1;
+    }
+    if (network_add_neuron(net, neurons[j], sources) < 0)
+      return -1;
+  }
+  return firstSignal;
+}
+
+int network_set_outputs(MPNetwork *net, const int *signals, int count)
+{
+  if (!net || !signals || count < 0)
+  {
+    fprintf(stderr, "Invalid network OR outputs\n");
+    return -1;
+  }
+  int *outputs = (int *)malloc((count ? count : 1) * sizeof(int));
+  if (!outputs)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+  for (int o = 0; o < count; o++)
+    outputs[o] = signals[o];
+  free(net->outputs);
+  net->outputs = outputs;
+  net->numOutputs = count;
+  return 0;
+}
+
+void delete_MPProgram(MPProgram *program)
+{
+  if (!program)
+    return;
+  free(program->code);
+  free(program->weights);
+  free(program->sources);
+  free(program->outputs);
+  free(program);
+}
+
+MPProgram *compile_network(const MPNetwork *net)
+{
+  if (!net)
+  {
+    fprintf(stderr, "Invalid network\n");
+    return NULL;
+  }
+  int numInputs = net->numInputs, numNeurons = net->numNeurons;
+  int numSignals = numInputs + numNeurons;
+  for (int e = 0; e < net->numEdges; e++)
+    if (net->sources[e] >= numSignals)
+    {
+      fprintf(stderr, "Source signal %d does not exist\n", net->sources[e]);
+      return NULL;
+    }
+  for (int o = 0; o < net->numOutputs; o++)
+    if (net->outputs[o] < 0 || net->outputs[o] >= numSignals)
+    {
+      fprintf(stderr, "Output signal %d does not exist\n", net->outputs[o]);
+      return NULL;
+    }
+
+  MPProgram *program = (MPProgram *)calloc(1, sizeof(MPProgram));
+  int *live = (int *)calloc(numSignals + 1, sizeof(int));
+  int *pending = (int *)calloc(numNeurons + 1, sizeof(int)); // unmet neuron sources
+  int *readerStart = (int *)calloc(numSignals + 1, sizeof(int));
+  int *readers = (int *)malloc((net->numEdges + 1) * sizeof(int));
+  int *order = (int *)malloc((numNeurons + 1) * sizeof(int));
+  int *level = (int *)calloc(numSignals + 1, sizeof(int));
+  int *lastUse = (int *)malloc((numSignals + 1) * sizeof(int));
+  int *slotOf = (int *)malloc((numSignals + 1) * sizeof(int));
+  int *freeSlots = (int *)malloc((numSignals + 1) * sizeof(int));
+  int status = program && live && pending && readerStart && readers && order && level && lastUse && slotOf &&
+                       freeSlots
+                   ? 0
+                   : -1;
+  if (status != 0)
+    fprintf(stderr, "Memory allocation failed\n");
+
+  // Keep what the outputs depend on (order doubles as the work stack)
+  int numLive = 0, top = 0;
+  for (int o = 0; status == 0 && o < net->numOutputs; o++)
+    if (!live[net->outputs[o]])
+    {
+      live[net->outputs[o]] = 1;
+      if (net->outputs[o] >= numInputs)
+        order[top++] = net->outputs[o] - numInputs;
+    }
+  while (status == 0 && top > 0)
+  {
+    int k = order[--top];
+    numLive++;
+    for (int e = net->first[k]; e < net->first[k] + net->fanIn[k]; e++)
+      if (!live[net->sources[e]])
+      {
+        live[net->sources[e]] = 1;
+        if (net->sources[e] >= numInputs)
+          order[top++] = net->sources[e] - numInputs;
+      }
+  }
+
+  // Kahn's algorithm over the live neurons: readers[] lists, per signal,
+  // the neurons reading it
+  if (status == 0)
+  {
+    for (int k = 0; k < numNeurons; k++)
+      if (live[numInputs + k])
+        for (int e = net->first[k]; e < net->first[k] + net->fanIn[k]; e++)
+        {
+          readerStart[net->sources[e] + 1]++;
+          pending[k] += net->sources[e] >= numInputs;
+        }
+    for (int sig = 0; sig < numSignals; sig++)
+      readerStart[sig + 1] += readerStart[sig];
+    int *next = slotOf; // scratch cursor, reused for slots below
+    for (int sig = 0; sig < numSignals; sig++)
+      next[sig] = readerStart[sig];
+    for (int k = 0; k < numNeurons; k++)
+      if (live[numInputs + k])
+        for (int e = net->first[k]; e < net->first[k] + net->fanIn[k]; e++)
+          readers[next[net->sources[e]]++] = k;
+
+    int head = 0, tail = 0;
+    for (int k = 0; k < numNeurons; k++)
+      if (live[numInputs + k] && pending[k] == 0)
+        order[tail++] = k;
+    while (head < tail)
+    {
+      int k = order[head++], sig = numInputs + k;
+      for (int e = net->first[k]; e < net->first[k] + net->fanIn[k]; e++)
+        level[sig] = level[net->sources[e]] + 1 > level[sig] ? level[net->sources[e]] + 1 : level[sig];
+      program->depth = level[sig] > program->depth ? level[sig] : program->depth;
+      for (int r = readerStart[sig]; r < readerStart[sig + 1]; r++)
+        if (--pending[readers[r]] == 0)
+          order[tail++] = readers[r];
+    }
+    if (tail < numLive)
+    {
+      fprintf(stderr, "Network has a cycle\n");
+      status = -1;
+    }
+  }
+
+  // Slots: a signal's slot is freed after its last reader, outputs never
+  if (status == 0)
+  {
+    program->numInputs = numInputs;
+    program->numOutputs = net->numOutputs;
+    program->numInstructions = numLive;
+    program->code = (MPInstruction *)malloc((numLive + 1) * sizeof(MPInstruction));
+    program->outputs = (int *)malloc((net->numOutputs + 1) * sizeof(int));
+    int numWeights = 0;
+    for (int p = 0; p < numLive; p++)
+      numWeights += net->fanIn[order[p]];
+    program->weights = (int *)malloc((numWeights + 1) * sizeof(int));
+    program->sources = (int *)malloc((numWeights + 1) * sizeof(int));
+    if (!program->code || !program->outputs || !program->weights || !program->sources)
+    {
+      fprintf(stderr, "Memory allocation failed\n");
+      status = -1;
+    }
+  }
+  if (status == 0)
+  {
+    for (int sig = 0; sig < numSignals; sig++)
+      lastUse[sig] = -1;
+    for (int p = 0; p < numLive; p++)
+    {
+      int k = order[p];
+      for (int e = net->first[k]; e < net->first[k] + net->fanIn[k]; e++)
+        lastUse[net->sources[e]] = p;
+    }
+    for (int o = 0; o < net->numOutputs; o++)
+      lastUse[net->outputs[o]] = numLive;
+
+    int numFree = 0, numSlots = numInputs, at = 0;
+    for (int i = 0; i < numInputs; i++)
+    {
+      slotOf[i] = i;
+      if (lastUse[i] < 0)
+        freeSlots[numFree++] = i;
+    }
+    for (int p = 0; p < numLive; p++)
+    {
+      int k = order[p], sig = numInputs + k, fanIn = net->fanIn[k];
+      MPInstruction *ins = &program->code[p];
+      for (int i = 0; i < fanIn; i++)
+      {
+        program->weights[at + i] = net->weights[net->first[k] + i];
+        program->sources[at + i] = slotOf[net->sources[net->first[k] + i]];
+      }
+      // The kernels read every input before writing, so a slot freed by
+      // this instruction can take its result
+      for (int i = 0; i < fanIn; i++)
+      {
+        int src = net->sources[net->first[k] + i];
+        if (lastUse[src] == p)
+        {
+          freeSlots[numFree++] = slotOf[src];
+          lastUse[src] = -2; // freed
+        }
+      }
+      slotOf[sig] = numFree > 0 ? freeSlots[--numFree] : numSlots++;
+      ins->op = slice_op(fanIn, program->weights + at, program->sources + at, net->thresholds[k]);
+      ins->dest = slotOf[sig];
+      at += fanIn;
+    }
+    program->numSlots = numSlots;
+    for (int o = 0; o < net->numOutputs; o++)
+      program->outputs[o] = slotOf[net->outputs[o]];
+  }
+
+  free(live);
+  free(pending);
+  free(readerStart);
+  free(readers);
+  free(order);
+  free(level);
+  free(lastUse);
+  free(slotOf);
+  free(freeSlots);
+  if (status != 0)
+  {
+    delete_MPProgram(program);
+    return NULL;
+  }
+  return program;
+}
+
+// inputs[i * numWords + w]: bit k is network input i of sample 64 * w + k;
+// outputs[o * numWords + w] likewise for network output o
+int program_run_sliced(const MPProgram *program, const uint64_t *inputs, size_t numWords, uint64_t *outputs)
+{
+  if (!program || !inputs || !outputs)
+  {
+    fprintf(stderr, "Invalid program OR inputs\n");
+    return -1;
+  }
+
+  uint64_t *scratch = (uint64_t *)malloc(((size_t)program->numSlots + 1) * SLICE_WORDS * sizeof(uint64_t));
+  if (!scratch)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+
+  SlicedFn fn = sliced_kernel();
+  for (size_t w0 = 0; w0 < numWords; w0 += SLICE_WORDS)
+  {
+    int words = numWords - w0 < SLICE_WORDS ? (int)(numWords - w0) : SLICE_WORDS;
+    for (int i = 0; i < program->numInputs; i++)
+      for (int k = 0; k < words; k++)
+        scratch[(size_t)i * SLICE_WORDS + k] = inputs[(size_t)i * numWords + w0 + k];
+
+    for (int p = 0; p < program->numInstructions; p++)
+    {
+      const MPInstruction *ins = &program->code[p];
+      uint64_t *dest = scratch + (size_t)ins->dest * SLICE_WORDS;
+      if (words == SLICE_WORDS)
+        fn(&ins->op, scratch, SLICE_WORDS, dest, SLICE_WORDS);
+      else
+        sliced_generic(&ins->op, scratch, SLICE_WORDS, dest, words);
+    }
+
+    for (int o = 0; o < program->numOutputs; o++)
+      for (int k = 0; k < words; k++)
+        outputs[(size_t)o * numWords + w0 + k] = scratch[(size_t)program->outputs[o] * SLICE_WORDS + k];
+  }
+  free(scratch);
+  return 0;
+}
+
+// Synthesize target and print the weights found, or why there are none
+static void print_synthesis(const char *name, const TruthTable *target, int maxWeight)
+{
+  MPNeuron *neuron = NULL;
+  clock_t start = clock();
+  SynthesisStatus status = synthesize_MPNeuron(target, maxWeight, 0, &neuron);
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("%-5s: ", name);
+  if (status == SYNTH_FOUND)
+  {
+    printf("weights");
+    for (int i = 0; i < neuron->numWeights; i++)
+      printf(" %d", neuron->weights[i]);
+    printf(", threshold %d", neuron->threshold);
+    delete_MPNeuron(neuron);
+  }
+  else if (status == SYNTH_NOT_THRESHOLD)
+    printf("not a threshold function");
+  else if (status == SYNTH_NO_WEIGHTS)
+    printf("no weights within +-%d", maxWeight);
+  else
+    printf("synthesis failed");
+  printf(" (%.3f s)\n", seconds);
+}
+
+// Rows in the usual order, first input as the most significant bit
+static void print_truth_table(const char *name, const MPNeuron *neuron)
+{
+  printf("\n----- ----- ----- %s GATE ----- ----- -----\n", name);
+  TruthTable *table = new_TruthTable(neuron, 1);
+  if (!table)
+    return;
+  int n = neuron->numWeights;
+  for (uint64_t row = 0; row < 1ull << n; row++)
   {
-    int result = activate(or_neuron, inputs[i], num_dimns);
+    uint64_t input = 0;
     printf("Input: ");
-    for (int j = 0; j < num_dimns; j++)
-      printf("%d ", inputs[i][j]);
+    for (int j = 0; j < n; j++)
+    {
+      int bit = (int)(row >> (n - 1 - j) & 1);
+      input |= (uint64_t)bit << j;
+      printf("%d ", bit);
+    }
+    printf("-> Output: %d\n", truth_table_output(table, input));
+  }
+  delete_TruthTable(table);
+}
 
-    printf("-> Output: %d\n", result);
+// bits-wide ripple-carry adder from threshold gates. Inputs are a (bits),
+// b (bits) and the carry in; outputs the sum bits then the carry out.
+// carry = MAJ(a, b, c) and sum = a + b + c - 2 carry >= 1. The sums are
+// added before the carries they read, which the compiler sorts out.
+static MPNetwork *new_adder_network(int bits)
+{
+  const int carry_weights[] = {1, 1, 1};
+  const int sum_weights[] = {1, 1, 1, -2};
+  MPNetwork *net = new_MPNetwork(2 * bits + 1);
+  MPNeuron *carry = new_MPNeuron(3, 2);
+  MPNeuron *sum = new_MPNeuron(4, 1);
+  int *outputs = (int *)malloc((bits + 1) * sizeof(int));
+  int ok = net && carry && sum && outputs;
+  if (ok)
+  {
+    set_weights(carry, carry_weights, 3);
+    set_weights(sum, sum_weights, 4);
+  }
+
+  int cin = 2 * bits, firstCarry = 2 * bits + 1 + bits;
+  for (int i = 0; ok && i < bits; i++)
+  {
+    int sources[] = {i, bits + i, i ? firstCarry + i - 1 : cin, firstCarry + i};
+    outputs[i] = network_add_neuron(net, sum, sources);
+    ok = outputs[i] >= 0;
+  }
+  for (int i = 0; ok && i < bits; i++)
+  {
+    int sources[] = {i, bits + i, i ? firstCarry + i - 1 : cin};
+    ok = network_add_neuron(net, carry, sources) >= 0;
+  }
+  if (ok)
+  {
+    outputs[bits] = firstCarry + bits - 1;
+    ok = network_set_outputs(net, outputs, bits + 1) == 0;
   }
-  delete_MPNeuron(or_neuron);
 
-  // NOT gate
-  printf("\n----- ----- ----- NOT GATE ----- ----- -----\n");
+  if (carry)
+    delete_MPNeuron(carry);
+  if (sum)
+    delete_MPNeuron(sum);
+  free(outputs);
+  if (!ok)
+  {
+    delete_MPNetwork(net);
+    return NULL;
+  }
+  return net;
+}
+
+int main()
+{
+  const int num_dimns = 3;
+  const int negative_weights[] = {-1, -1, -1};
+
+  MPNeuron *and_neuron = new_MPNeuron(num_dimns, num_dimns);
+  MPNeuron *or_neuron = new_MPNeuron(num_dimns, 1);
   MPNeuron *not_neuron = new_MPNeuron(1, 0);
+  MPNeuron *nand_neuron = new_MPNeuron(num_dimns, -num_dimns + 1);
+  MPNeuron *nor_neuron = new_MPNeuron(num_dimns, 0);
+  if (!and_neuron || !or_neuron || !not_neuron || !nand_neuron || !nor_neuron)
+    return 1;
   not_neuron->weights[0] = -1;
-  const int not_inputs[2][1] = {{0}, {1}};
-  for (int i = 0; i < 2; i++)
+  set_weights(nand_neuron, negative_weights, num_dimns);
+  set_weights(nor_neuron, negative_weights, num_dimns);
+
+  print_truth_table("AND", and_neuron);
+  print_truth_table("OR", or_neuron);
+  print_truth_table("NOT", not_neuron);
+  print_truth_table("NAND", nand_neuron);
+  print_truth_table("NOR", nor_neuron);
+
+  // The gates above were hand-picked; recover weights from their tables
+  printf("\n----- ----- ----- SYNTHESIS ----- ----- -----\n");
+  const MPNeuron *gates[] = {and_neuron, or_neuron, not_neuron, nand_neuron, nor_neuron};
+  const char *gate_names[] = {"AND", "OR", "NOT", "NAND", "NOR"};
+  for (int g = 0; g < 5; g++)
   {
-    int result = activate(not_neuron, not_inputs[i], 1);
-    printf("Input: %d -> Output: %d\n", not_inputs[i][0], result);
+    TruthTable *table = new_TruthTable(gates[g], 1);
+    if (table)
+      print_synthesis(gate_names[g], table, 4);
+    delete_TruthTable(table);
   }
+  const uint64_t xor_bits = 0x96; // 3-input parity
+  TruthTable *xor_table = new_TruthTable_from_bits(num_dimns, &xor_bits);
+  if (xor_table)
+    print_synthesis("XOR", xor_table, 4);
+  delete_TruthTable(xor_table);
+
+  // A 12-input neuron with weights up to 40, recovered from its table
+  const int target_weights[] = {39, -26, 24, -14, 30, 9, 29, 27, 19, 7, -14, 26};
+  MPNeuron *target_neuron = new_MPNeuron(12, 36);
+  TruthTable *target_table = NULL;
+  if (target_neuron)
+  {
+    set_weights(target_neuron, target_weights, 12);
+    target_table = new_TruthTable(target_neuron, 1);
+    delete_MPNeuron(target_neuron);
+  }
+  if (target_table)
+  {
+    print_synthesis("12-IN", target_table, 40);
+    print_synthesis("12-IN", target_table, 32);
+  }
+  delete_TruthTable(target_table);
+
+  delete_MPNeuron(and_neuron);
+  delete_MPNeuron(or_neuron);
   delete_MPNeuron(not_neuron);
+  delete_MPNeuron(nand_neuron);
+  delete_MPNeuron(nor_neuron);
 
-  // NAND gate
-  printf("\n----- ----- ----- NAND GATE ----- ----- -----\n");
-  MPNeuron *nand_neuron = new_MPNeuron(num_dimns, -num_dimns + 1);
-  const int nand_weights[] = {-1, -1, -1};
-  set_weights(nand_neuron, nand_weights, num_dimns);
-  for (int i = 0; i < num_samples; i++)
+  // Wide gates over all 2^30 inputs: the threaded truth-table engine,
+  // cross-checked against bit-sliced evaluation
+  printf("\n----- ----- ----- 30-INPUT GATES ----- ----- -----\n");
+  const int wide_dimns = 30;
+  const int wide_thresholds[] = {wide_dimns, 1, wide_dimns / 2};
+  const char *wide_names[] = {"AND", "OR", "MAJ"};
+  for (int g = 0; g < 3; g++)
   {
-    int result = activate(nand_neuron, inputs[i], num_dimns);
-    printf("Input: ");
-    for (int j = 0; j < num_dimns; j++)
-      printf("%d ", inputs[i][j]);
+    MPNeuron *wide_neuron = new_MPNeuron(wide_dimns, wide_thresholds[g]);
+    PackedMPNeuron *packed = wide_neuron ? pack_MPNeuron(wide_neuron) : NULL;
+    if (!packed)
+    {
+      if (wide_neuron)
+        delete_MPNeuron(wide_neuron);
+      return 1;
+    }
 
-    printf("-> Output: %d\n", result);
+    clock_t start = clock();
+    TruthTable *table = new_TruthTable(wide_neuron, 0);
+    double tableSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    long long ones = count_ones_sliced(packed);
+    double slicedSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if (table)
+      printf("%-3s: %llu of %lld inputs -> 1 (table %.2f s, bit-sliced %.2f s, %s)\n", wide_names[g],
+             (unsigned long long)table->ones, 1ll << wide_dimns, tableSeconds, slicedSeconds,
+             (long long)table->ones == ones ? "agree" : "DISAGREE");
+    delete_TruthTable(table);
+    delete_PackedMPNeuron(packed);
+    delete_MPNeuron(wide_neuron);
   }
-  delete_MPNeuron(nand_neuron);
 
-  // NOR gate
-  printf("\n----- ----- ----- NOR GATE ----- ----- -----\n");
-  MPNeuron *nor_neuron = new_MPNeuron(num_dimns, 0);
-  const int nor_weights[] = {-1, -1, -1};
-  set_weights(nor_neuron, nor_weights, num_dimns);
-  for (int i = 0; i < num_samples; i++)
+
+  // A 16-bit adder network, compiled and run bit-sliced over a batch of
+  // random additions
+  printf("\n----- ----- ----- 16-BIT ADDER NETWORK ----- ----- -----\n");
+  const int adder_bits = 16;
+  const size_t adder_words = 1 << 14;
+  MPNetwork *adder = new_adder_network(adder_bits);
+  MPProgram *program = adder ? compile_network(adder) : NULL;
+  delete_MPNetwork(adder);
+  uint64_t *adder_in = (uint64_t *)calloc((size_t)(2 * adder_bits + 1) * adder_words, sizeof(uint64_t));
+  uint64_t *adder_out = (uint64_t *)malloc((size_t)(adder_bits + 1) * adder_words * sizeof(uint64_t));
+  if (!program || !adder_in || !adder_out)
   {
-    int result = activate(nor_neuron, inputs[i], num_dimns);
-    printf("Input: ");
-    for (int j = 0; j < num_dimns; j++)
-      printf("%d ", inputs[i][j]);
+    delete_MPProgram(program);
+    free(adder_in);
+    free(adder_out);
+    return 1;
+  }
+
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  for (int i = 0; i < 2 * adder_bits + 1; i++)
+    for (size_t w = 0; w < adder_words; w++)
+    {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      adder_in[(size_t)i * adder_words + w] = state;
+    }
+
+  clock_t start = clock();
+  program_run_sliced(program, adder_in, adder_words, adder_out);
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
 
-    printf("-> Output: %d\n", result);
+  size_t wrong = 0;
+  for (size_t s = 0; s < adder_words * 64; s++)
+  {
+    size_t w = s / 64;
+    int k = (int)(s % 64);
+    uint32_t a = 0, b = 0, got = 0;
+    for (int i = 0; i < adder_bits; i++)
+    {
+      a |= (uint32_t)(adder_in[(size_t)i * adder_words + w] >> k & 1) << i;
+      b |= (uint32_t)(adder_in[(size_t)(adder_bits + i) * adder_words + w] >> k & 1) << i;
+    }
+    uint32_t cin = (uint32_t)(adder_in[(size_t)2 * adder_bits * adder_words + w] >> k & 1);
+    for (int o = 0; o <= adder_bits; o++)
+      got |= (uint32_t)(adder_out[(size_t)o * adder_words + w] >> k & 1) << o;
+    wrong += got != a + b + cin;
   }
-  delete_MPNeuron(nor_neuron);
+  printf("%d neurons, depth %d, %d scratch slots\n", program->numInstructions, program->depth,
+         program->numSlots);
+  printf("%zu additions in %.3f s (%.1f M/s), %zu wrong\n", adder_words * 64, seconds,
+         seconds > 0 ? adder_words * 64 / seconds / 1e6 : 0.0, wrong);
+
+  delete_MPProgram(program);
+  free(adder_in);
+  free(adder_out);
 
   return 0;
 }
@@ -1,10 +1,24 @@
 // WAP to implement a learnable Perceptron
+//
+// Build: gcc -O3 lab-3.c -o lab-3 -lpthread
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #define PERCEPTRON_D_TYPE float
+#define DATASET_ALIGN 64
 
 typedef struct Perceptron
 {
@@ -50,116 +64,1844 @@ void delete_Perceptron(Perceptron *p)
   }
 }
 
+// Datasets
+// One aligned allocation holds the features and, after them, the labels.
+// Row-major keeps sample i at X + i * stride with the row padded to
+// DATASET_ALIGN bytes; column-major keeps feature j at X + j * stride, a
+// run of numSamples values (padded likewise). Padding is zero.
+typedef enum DatasetLayout
+{
+  DATASET_ROW_MAJOR,
+  DATASET_COLUMN_MAJOR
+} DatasetLayout;
+
+typedef struct Dataset
+{
+  PERCEPTRON_D_TYPE *X;
+  PERCEPTRON_D_TYPE *y;
+  int numSamples;
+  int numInputs;
+  size_t stride; // elements from one row (or column) to the next
+  DatasetLayout layout;
+} Dataset;
+
+// Samples per block when column-major data is gathered into rows
+#define DATASET_BLOCK 256
+
+static void *aligned_malloc(size_t size)
+{
+  size = (size + DATASET_ALIGN - 1) & ~(size_t)(DATASET_ALIGN - 1);
+#ifdef _WIN32
+  return _aligned_malloc(size ? size : DATASET_ALIGN, DATASET_ALIGN);
+#else
+  void *ptr = NULL;
+  return posix_memalign(&ptr, DATASET_ALIGN, size ? size : DATASET_ALIGN) == 0 ? ptr : NULL;
+#endif
+}
+
+static void aligned_free(void *ptr)
+{
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+// n elements rounded up to a whole number of DATASET_ALIGN bytes
+static size_t dataset_padded(size_t n)
+{
+  size_t perLine = DATASET_ALIGN / sizeof(PERCEPTRON_D_TYPE);
+  return (n + perLine - 1) / perLine * perLine;
+}
+
+// Zero-filled dataset
+Dataset *new_Dataset(int numSamples, int numInputs, DatasetLayout layout)
+{
+  if (numSamples < 0 || numInputs <= 0)
+  {
+    fprintf(stderr, "Invalid dataset size\n");
+    return NULL;
+  }
+
+  Dataset *d = malloc(sizeof(*d));
+  if (!d)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+
+  size_t stride = layout == DATASET_ROW_MAJOR ? dataset_padded(numInputs) : dataset_padded(numSamples);
+  size_t lines = layout == DATASET_ROW_MAJOR ? (size_t)numSamples : (size_t)numInputs;
+  size_t labels = dataset_padded(numSamples);
+  size_t bytes = (stride * lines + labels) * sizeof(PERCEPTRON_D_TYPE);
+  d->X = aligned_malloc(bytes);
+  if (!d->X)
+  {
+    fprintf(stderr, "Memory allocation for dataset failed\n");
+    free(d);
+    return NULL;
+  }
+  memset(d->X, 0, bytes);
+
+  d->y = d->X + stride * lines;
+  d->numSamples = numSamples;
+  d->numInputs = numInputs;
+  d->stride = stride;
+  d->layout = layout;
+  return d;
+}
+
+void delete_Dataset(Dataset *d)
+{
+  if (d)
+  {
+    aligned_free(d->X);
+    free(d);
+  }
+}
+
+// Feature j of sample i, in either layout
+static PERCEPTRON_D_TYPE *dataset_at(const Dataset *d, int i, int j)
+{
+  return d->layout == DATASET_ROW_MAJOR ? d->X + (size_t)i * d->stride + j : d->X + (size_t)j * d->stride + i;
+}
+
+// Rows for samples [i0, i0 + count), count <= DATASET_BLOCK: row-major data
+// is used in place, column-major data is gathered into rows (DATASET_BLOCK
+// rows of numInputs), one sequential run per feature
+static const PERCEPTRON_D_TYPE *dataset_block(const Dataset *d, int i0, int count,
+                                              PERCEPTRON_D_TYPE *rows, size_t *stride)
+{
+  if (d->layout == DATASET_ROW_MAJOR)
+  {
+    *stride = d->stride;
+    return d->X + (size_t)i0 * d->stride;
+  }
+
+  for (int j = 0; j < d->numInputs; j++)
+  {
+    const PERCEPTRON_D_TYPE *column = d->X + (size_t)j * d->stride + i0;
+    for (int b = 0; b < count; b++)
+      rows[(size_t)b * d->numInputs + j] = column[b];
+  }
+  *stride = d->numInputs;
+  return rows;
+}
+
+// Copy of float ** rows, as made by create_dataset
+Dataset *dataset_from_rows(PERCEPTRON_D_TYPE **X, PERCEPTRON_D_TYPE *y,
+                           int numSamples, int numInputs, DatasetLayout layout)
+{
+  if (!X || !y)
+  {
+    fprintf(stderr, "Invalid inputs\n");
+    return NULL;
+  }
+
+  Dataset *d = new_Dataset(numSamples, numInputs, layout);
+  if (!d)
+    return NULL;
+
+  for (int i = 0; i < numSamples; i++)
+  {
+    for (int j = 0; j < numInputs; j++)
+      *dataset_at(d, i, j) = X[i][j];
+    d->y[i] = y[i];
+  }
+  return d;
+}
+
+// Every binary input vector, most significant bit first, labelled with the
+// AND of its bits (the same data create_dataset makes)
+Dataset *new_AND_Dataset(int numInputs, DatasetLayout layout)
+{
+  if (numInputs <= 0 || numInputs > 30)
+  {
+    fprintf(stderr, "Invalid number of inputs\n");
+    return NULL;
+  }
+
+  int numSamples = 1 << numInputs; // 2^numInputs
+  Dataset *d = new_Dataset(numSamples, numInputs, layout);
+  if (!d)
+    return NULL;
+
+  if (layout == DATASET_ROW_MAJOR)
+  {
+    for (int i = 0; i < numSamples; i++)
+      for (int j = 0; j < numInputs; j++)
+        d->X[(size_t)i * d->stride + numInputs - 1 - j] = (i >> j) & 1;
+  }
+  else
+  {
+    for (int j = 0; j < numInputs; j++)
+      for (int i = 0; i < numSamples; i++)
+        d->X[(size_t)(numInputs - 1 - j) * d->stride + i] = (i >> j) & 1;
+  }
+  d->y[numSamples - 1] = 1;
+  return d;
+}
+
 PERCEPTRON_D_TYPE activate(PERCEPTRON_D_TYPE x)
 {
-  return x >= 0 ? 1 : 0;
+  return x >= 0 ? 1 : 0;
+}
+
+PERCEPTRON_D_TYPE predict(Perceptron *p,
+                          PERCEPTRON_D_TYPE *inputs, int numInputs)
+{
+  if (!p)
+  {
+    fprintf(stderr, "Invalid Perceptron\n");
+    return -1; // Indicate an error
+  }
+
+  if (!inputs || numInputs != p->numWeights)
+  {
+    fprintf(stderr, "Invalid inputs or input size mismatch\n");
+    return -1; // Indicate an error
+  }
+
+  PERCEPTRON_D_TYPE sum = p->bias;
+  for (int i = 0; i < p->numWeights; i++)
+    sum += p->weights[i] * inputs[i];
+
+  return activate(sum);
+}
+
+void update(Perceptron *p,
+            PERCEPTRON_D_TYPE *inputs, int numInputs,
+            PERCEPTRON_D_TYPE error)
+{
+  if (!p)
+  {
+    fprintf(stderr, "Invalid Perceptron\n");
+    return;
+  }
+
+  if (!inputs || numInputs != p->numWeights)
+  {
+    fprintf(stderr, "Invalid inputs or input size mismatch\n");
+    return;
+  }
+
+  PERCEPTRON_D_TYPE delta = p->learningRate * error;
+  p->bias += delta;
+  for (int i = 0; i < p->numWeights; i++)
+    p->weights[i] += delta * inputs[i];
+}
+
+// Training kernels
+// dot returns bias + w . x; step is one unchecked SGD step on sample x:
+// the prediction, its error against label, and, when wrong, the bias and
+// weight update (an axpy), all in one pass over the weights. Callers
+// validate once per call, not per sample. The x86 versions need
+// PERCEPTRON_D_TYPE to be float and sum in a different order than the
+// scalar loop, so results can differ in the last bits.
+typedef struct PerceptronKernels
+{
+  const char *name;
+  PERCEPTRON_D_TYPE (*dot)(const PERCEPTRON_D_TYPE *weights, PERCEPTRON_D_TYPE bias,
+                           const PERCEPTRON_D_TYPE *x, int n);
+  PERCEPTRON_D_TYPE (*step)(PERCEPTRON_D_TYPE *weights, PERCEPTRON_D_TYPE *bias,
+                            const PERCEPTRON_D_TYPE *x, int n,
+                            PERCEPTRON_D_TYPE label, PERCEPTRON_D_TYPE learningRate);
+  // The same for bit-packed binary samples: input j is bit j % 64 of
+  // features[j / 64], and only the weights of set bits are touched
+  PERCEPTRON_D_TYPE (*bitDot)(const PERCEPTRON_D_TYPE *weights, PERCEPTRON_D_TYPE bias,
+                              const uint64_t *features, int numWords);
+  PERCEPTRON_D_TYPE (*bitStep)(PERCEPTRON_D_TYPE *weights, PERCEPTRON_D_TYPE *bias,
+                               const uint64_t *features, int numWords,
+                               PERCEPTRON_D_TYPE label, PERCEPTRON_D_TYPE learningRate);
+} PerceptronKernels;
+
+static PERCEPTRON_D_TYPE dot_scalar(const PERCEPTRON_D_TYPE *weights, PERCEPTRON_D_TYPE bias,
+                                    const PERCEPTRON_D_TYPE *x, int n)
+{
+  PERCEPTRON_D_TYPE sum = bias;
+  for (int i = 0; i < n; i++)
+    sum += weights[i] * x[i];
+  return sum;
+}
+
+static PERCEPTRON_D_TYPE step_scalar(PERCEPTRON_D_TYPE *weights, PERCEPTRON_D_TYPE *bias,
+                                     const PERCEPTRON_D_TYPE *x, int n,
+                                     PERCEPTRON_D_TYPE label, PERCEPTRON_D_TYPE learningRate)
+{
+  PERCEPTRON_D_TYPE error = label - activate(dot_scalar(weights, *bias, x, n));
+  if (error != 0)
+  {
+    PERCEPTRON_D_TYPE delta = learningRate * error;
+    *bias += delta;
+    for (int i = 0; i < n; i++)
+      weights[i] += delta * x[i];
+  }
+  return error;
+}
+
+static int count_trailing_zeros(uint64_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1))
+  {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static int popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll(x);
+#else
+  int n = 0;
+  for (; x; x &= x - 1)
+    n++;
+  return n;
+#endif
+}
+
+// Bit scan: one add per set bit
+static PERCEPTRON_D_TYPE bit_dot_scalar(const PERCEPTRON_D_TYPE *weights, PERCEPTRON_D_TYPE bias,
+                                        const uint64_t *features, int numWords)
+{
+  PERCEPTRON_D_TYPE sum = bias;
+  for (int k = 0; k < numWords; k++)
+    for (uint64_t word = features[k]; word; word &= word - 1)
+      sum += weights[64 * k + count_trailing_zeros(word)];
+  return sum;
+}
+
+static PERCEPTRON_D_TYPE bit_step_scalar(PERCEPTRON_D_TYPE *weights, PERCEPTRON_D_TYPE *bias,
+                                         const uint64_t *features, int numWords,
+                                         PERCEPTRON_D_TYPE label, PERCEPTRON_D_TYPE learningRate)
+{
+  PERCEPTRON_D_TYPE error = label - activate(bit_dot_scalar(weights, *bias, features, numWords));
+  if (error != 0)
+  {
+    PERCEPTRON_D_TYPE delta = learningRate * error;
+    *bias += delta;
+    for (int k = 0; k < numWords; k++)
+      for (uint64_t word = features[k]; word; word &= word - 1)
+        weights[64 * k + count_trailing_zeros(word)] += delta;
+  }
+  return error;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PERCEPTRON_X86_KERNELS 1
+#include <immintrin.h>
+
+__attribute__((target("avx2,fma"))) static float hsum_avx2(__m256 v)
+{
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+// Eight lanes, two accumulators, scalar tail
+__attribute__((target("avx2,fma"))) static PERCEPTRON_D_TYPE dot_avx2(const PERCEPTRON_D_TYPE *weights,
+                                                                     PERCEPTRON_D_TYPE bias,
+                                                                     const PERCEPTRON_D_TYPE *x, int n)
+{
+  const float *w = (const float *)weights, *xs = (const float *)x;
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + i), _mm256_loadu_ps(xs + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(w + i + 8), _mm256_loadu_ps(xs + i + 8), acc1);
+  }
+  if (i + 8 <= n)
+  {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + i), _mm256_loadu_ps(xs + i), acc0);
+    i += 8;
+  }
+  float sum = (float)bias + hsum_avx2(_mm256_add_ps(acc0, acc1));
+  for (; i < n; i++)
+    sum += w[i] * xs[i];
+  return sum;
+}
+
+__attribute__((target("avx2,fma"))) static PERCEPTRON_D_TYPE step_avx2(PERCEPTRON_D_TYPE *weights,
+                                                                      PERCEPTRON_D_TYPE *bias,
+                                                                      const PERCEPTRON_D_TYPE *x, int n,
+                                                                      PERCEPTRON_D_TYPE label,
+                                                                      PERCEPTRON_D_TYPE learningRate)
+{
+  PERCEPTRON_D_TYPE error = label - activate(dot_avx2(weights, *bias, x, n));
+  if (error != 0)
+  {
+    float *w = (float *)weights;
+    const float *xs = (const float *)x;
+    float delta = (float)(learningRate * error);
+    __m256 d = _mm256_set1_ps(delta);
+    *bias += delta;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+      _mm256_storeu_ps(w + i, _mm256_fmadd_ps(d, _mm256_loadu_ps(xs + i), _mm256_loadu_ps(w + i)));
+    for (; i < n; i++)
+      w[i] += delta * xs[i];
+  }
+  return error;
+}
+
+// Sixteen lanes; the tail is a masked load rather than a scalar loop
+__attribute__((target("avx512f"))) static PERCEPTRON_D_TYPE dot_avx512(const PERCEPTRON_D_TYPE *weights,
+                                                                      PERCEPTRON_D_TYPE bias,
+                                                                      const PERCEPTRON_D_TYPE *x, int n)
+{
+  const float *w = (const float *)weights, *xs = (const float *)x;
+  __m512 acc = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    acc = _mm512_fmadd_ps(_mm512_loadu_ps(w + i), _mm512_loadu_ps(xs + i), acc);
+  if (i < n)
+  {
+    __mmask16 tail = (__mmask16)((1u << (n - i)) - 1);
+    acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, w + i), _mm512_maskz_loadu_ps(tail, xs + i), acc);
+  }
+  return (float)bias + _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f"))) static PERCEPTRON_D_TYPE step_avx512(PERCEPTRON_D_TYPE *weights,
+                                                                       PERCEPTRON_D_TYPE *bias,
+                                                                       const PERCEPTRON_D_TYPE *x, int n,
+                                                                       PERCEPTRON_D_TYPE label,
+                                                                       PERCEPTRON_D_TYPE learningRate)
+{
+  PERCEPTRON_D_TYPE error = label - activate(dot_avx512(weights, *bias, x, n));
+  if (error != 0)
+  {
+    float *w = (float *)weights;
+    const float *xs = (const float *)x;
+    float delta = (float)(learningRate * error);
+    __m512 d = _mm512_set1_ps(delta);
+    *bias += delta;
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+      _mm512_storeu_ps(w + i, _mm512_fmadd_ps(d, _mm512_loadu_ps(xs + i), _mm512_loadu_ps(w + i)));
+    if (i < n)
+    {
+      __mmask16 tail = (__mmask16)((1u << (n - i)) - 1);
+      __m512 updated = _mm512_fmadd_ps(d, _mm512_maskz_loadu_ps(tail, xs + i), _mm512_maskz_loadu_ps(tail, w + i));
+      _mm512_mask_storeu_ps(w + i, tail, updated);
+    }
+  }
+  return error;
+}
+
+// Sixteen inputs per masked add: the feature bits are the lane mask, and
+// masked-off lanes are never loaded, so weights need no padding
+__attribute__((target("avx512f"))) static PERCEPTRON_D_TYPE bit_dot_avx512(const PERCEPTRON_D_TYPE *weights,
+                                                                          PERCEPTRON_D_TYPE bias,
+                                                                          const uint64_t *features, int numWords)
+{
+  const float *w = (const float *)weights;
+  __m512 acc = _mm512_setzero_ps();
+  for (int k = 0; k < numWords; k++)
+    for (uint64_t word = features[k], q = 0; word; word >>= 16, q += 16)
+      if (word & 0xFFFF)
+        acc = _mm512_add_ps(acc, _mm512_maskz_loadu_ps((__mmask16)word, w + 64 * k + q));
+  return (float)bias + _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f"))) static PERCEPTRON_D_TYPE bit_step_avx512(PERCEPTRON_D_TYPE *weights,
+                                                                           PERCEPTRON_D_TYPE *bias,
+                                                                           const uint64_t *features, int numWords,
+                                                                           PERCEPTRON_D_TYPE label,
+                                                                           PERCEPTRON_D_TYPE learningRate)
+{
+  PERCEPTRON_D_TYPE error = label - activate(bit_dot_avx512(weights, *bias, features, numWords));
+  if (error != 0)
+  {
+    float *w = (float *)weights;
+    float delta = (float)(learningRate * error);
+    __m512 d = _mm512_set1_ps(delta);
+    *bias += delta;
+    for (int k = 0; k < numWords; k++)
+      for (uint64_t word = features[k], q = 0; word; word >>= 16, q += 16)
+        if (word & 0xFFFF)
+        {
+          __mmask16 m = (__mmask16)word;
+          _mm512_mask_storeu_ps(w + 64 * k + q, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, w + 64 * k + q), d));
+        }
+  }
+  return error;
+}
+#endif
+
+static const PerceptronKernels kernelsScalar = {"scalar", dot_scalar, step_scalar, bit_dot_scalar, bit_step_scalar};
+#ifdef PERCEPTRON_X86_KERNELS
+static const PerceptronKernels kernelsAvx2 = {"avx2", dot_avx2, step_avx2, bit_dot_scalar, bit_step_scalar};
+static const PerceptronKernels kernelsAvx512 = {"avx512", dot_avx512, step_avx512, bit_dot_avx512, bit_step_avx512};
+#endif
+
+static const PerceptronKernels *perceptron_kernels(void)
+{
+  static const PerceptronKernels *kernels = NULL;
+  if (kernels)
+    return kernels;
+  kernels = &kernelsScalar;
+#ifdef PERCEPTRON_X86_KERNELS
+  int isFloat = _Generic((PERCEPTRON_D_TYPE)0, float: 1, default: 0);
+  __builtin_cpu_init();
+  if (isFloat && __builtin_cpu_supports("avx512f"))
+    kernels = &kernelsAvx512;
+  else if (isFloat && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    kernels = &kernelsAvx2;
+#endif
+  return kernels;
+}
+
+void fit(Perceptron *p,
+         PERCEPTRON_D_TYPE **X, PERCEPTRON_D_TYPE *y,
+         int numSamples, int numInputs, int numEpochs)
+{
+  if (!p)
+  {
+    fprintf(stderr, "Invalid Perceptron\n");
+    return;
+  }
+
+  if (!X || !y || numInputs != p->numWeights)
+  {
+    fprintf(stderr, "Invalid inputs or input size mismatch\n");
+    return;
+  }
+
+  const PerceptronKernels *kernels = perceptron_kernels();
+  for (int epoch = 0; epoch < numEpochs; epoch++)
+  {
+    PERCEPTRON_D_TYPE lossPerEpoch = 0;
+    for (int i = 0; i < numSamples; i++)
+    {
+      PERCEPTRON_D_TYPE error = kernels->step(p->weights, &p->bias, X[i], numInputs, y[i], p->learningRate);
+      lossPerEpoch += error * error;
+    }
+    printf("Epoch %04d | Loss: %8.4f\n", epoch + 1, lossPerEpoch);
+
+    if (lossPerEpoch == 0)
+    {
+      printf("Training complete at epoch %04d\n", epoch + 1);
+      break;
+    }
+  }
+}
+
+PERCEPTRON_D_TYPE evaluate(Perceptron *p,
+                           PERCEPTRON_D_TYPE **X, PERCEPTRON_D_TYPE *y,
+                           int numSamples, int numInputs)
+{
+  if (!p)
+  {
+    fprintf(stderr, "Invalid Perceptron\n");
+    return -1;
+  }
+
+  if (!X || !y || numInputs != p->numWeights)
+  {
+    fprintf(stderr, "Invalid inputs or input size mismatch\n");
+    return -1;
+  }
+
+  const PerceptronKernels *kernels = perceptron_kernels();
+  int correct = 0;
+  for (int i = 0; i < numSamples; i++)
+  {
+    PERCEPTRON_D_TYPE prediction = activate(kernels->dot(p->weights, p->bias, X[i], numInputs));
+    if (prediction == y[i])
+      correct++;
+  }
+  return (PERCEPTRON_D_TYPE)correct / numSamples;
+}
+
+// Dataset versions of predict, fit and evaluate. Row-major data is read row
+// by row; column-major data is read a block of DATASET_BLOCK samples at a
+// time, one sequential run per feature, so both stream through memory in
+// order and the hardware prefetcher keeps up.
+PERCEPTRON_D_TYPE predict_sample(Perceptron *p, const Dataset *d, int i)
+{
+  if (!p || !d)
+  {
+    fprintf(stderr, "Invalid Perceptron or dataset\n");
+    return -1; // Indicate an error
+  }
+
+  if (i < 0 || i >= d->numSamples || d->numInputs != p->numWeights)
+  {
+    fprintf(stderr, "Invalid sample or input size mismatch\n");
+    return -1; // Indicate an error
+  }
+
+  if (d->layout == DATASET_ROW_MAJOR)
+    return predict(p, d->X + (size_t)i * d->stride, d->numInputs);
+
+  PERCEPTRON_D_TYPE sum = p->bias;
+  for (int j = 0; j < p->numWeights; j++)
+    sum += p->weights[j] * d->X[(size_t)j * d->stride + i];
+  return activate(sum);
+}
+
+// Returns the number of epochs run
+int fit_dataset(Perceptron *p, const Dataset *d, int numEpochs)
+{
+  if (!p || !d)
+  {
+    fprintf(stderr, "Invalid Perceptron or dataset\n");
+    return -1;
+  }
+
+  if (d->numInputs != p->numWeights)
+  {
+    fprintf(stderr, "Invalid inputs or input size mismatch\n");
+    return -1;
+  }
+
+  // Column-major samples are gathered into rows, a block at a time
+  const PerceptronKernels *kernels = perceptron_kernels();
+  int numInputs = d->numInputs;
+  PERCEPTRON_D_TYPE *rows = NULL;
+  if (d->layout == DATASET_COLUMN_MAJOR)
+  {
+    rows = aligned_malloc((size_t)DATASET_BLOCK * numInputs * sizeof(PERCEPTRON_D_TYPE));
+    if (!rows)
+    {
+      fprintf(stderr, "Memory allocation failed\n");
+      return -1;
+    }
+  }
+
+  int epoch = 0;
+  while (epoch < numEpochs)
+  {
+    PERCEPTRON_D_TYPE lossPerEpoch = 0;
+    for (int i0 = 0; i0 < d->numSamples; i0 += DATASET_BLOCK)
+    {
+      int count = d->numSamples - i0 < DATASET_BLOCK ? d->numSamples - i0 : DATASET_BLOCK;
+      size_t stride;
+      const PERCEPTRON_D_TYPE *block = dataset_block(d, i0, count, rows, &stride);
+      for (int b = 0; b < count; b++)
+      {
+        PERCEPTRON_D_TYPE error = kernels->step(p->weights, &p->bias, block + (size_t)b * stride, numInputs,
+                                                d->y[i0 + b], p->learningRate);
+        lossPerEpoch += error * error;
+      }
+    }
+    printf("Epoch %04d | Loss: %8.4f\n", ++epoch, lossPerEpoch);
+
+    if (lossPerEpoch == 0)
+    {
+      printf("Training complete at epoch %04d\n", epoch);
+      break;
+    }
+  }
+  aligned_free(rows);
+  return epoch;
+}
+
+PERCEPTRON_D_TYPE evaluate_dataset(Perceptron *p, const Dataset *d)
+{
+  if (!p || !d)
+  {
+    fprintf(stderr, "Invalid Perceptron or dataset\n");
+    return -1;
+  }
+
+  if (d->numInputs != p->numWeights)
+  {
+    fprintf(stderr, "Invalid inputs or input size mismatch\n");
+    return -1;
+  }
+
+  int correct = 0;
+  if (d->layout == DATASET_ROW_MAJOR)
+  {
+    const PerceptronKernels *kernels = perceptron_kernels();
+    for (int i = 0; i < d->numSamples; i++)
+      if (activate(kernels->dot(p->weights, p->bias, d->X + (size_t)i * d->stride, d->numInputs)) == d->y[i])
+        correct++;
+  }
+  else
+  {
+    // Sums for a block of samples, one feature column at a time
+    PERCEPTRON_D_TYPE sums[DATASET_BLOCK];
+    for (int i0 = 0; i0 < d->numSamples; i0 += DATASET_BLOCK)
+    {
+      int count = d->numSamples - i0 < DATASET_BLOCK ? d->numSamples - i0 : DATASET_BLOCK;
+      for (int b = 0; b < count; b++)
+        sums[b] = p->bias;
+      for (int j = 0; j < d->numInputs; j++)
+      {
+        const PERCEPTRON_D_TYPE *column = d->X + (size_t)j * d->stride + i0;
+        PERCEPTRON_D_TYPE w = p->weights[j];
+        for (int b = 0; b < count; b++)
+          sums[b] += w * column[b];
+      }
+      for (int b = 0; b < count; b++)
+        if (activate(sums[b]) == d->y[i0 + b])
+          correct++;
+    }
+  }
+  return d->numSamples ? (PERCEPTRON_D_TYPE)correct / d->numSamples : 0;
+}
+
+// Parallel training
+// TRAIN_HOGWILD: each thread runs plain SGD over its own share of every
+// epoch and writes the shared weights without locks. Updates from two
+// threads can race and one can be lost, which SGD shrugs off, and nobody
+// waits. TRAIN_MINIBATCH: each batch of batchSize samples is split across
+// the threads, which score their samples against the weights as of the
+// start of the batch and sum the updates in private buffers; the threads
+// then add all buffers to the weights, each for its own slice of them.
+// The result depends on the thread count but not on timing.
+// TRAIN_SEQUENTIAL is the single-threaded baseline (same as fit_dataset).
+#define TRAINING_MAX_THREADS 64
+
+typedef enum TrainingMode
+{
+  TRAIN_SEQUENTIAL,
+  TRAIN_HOGWILD,
+  TRAIN_MINIBATCH
+} TrainingMode;
+
+typedef struct TrainingOptions
+{
+  TrainingMode mode;
+  int numThreads; // <= 0 uses every hardware thread
+  int batchSize;  // samples per mini-batch
+  int numEpochs;
+  int verbose; // print the loss of every epoch
+} TrainingOptions;
+
+typedef struct TrainingReport
+{
+  int epochs;
+  double seconds;
+  PERCEPTRON_D_TYPE loss; // of the last epoch
+} TrainingReport;
+
+// Reusable barrier; the generation tells a wakeup of this round from the next
+typedef struct TrainingBarrier
+{
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int count;
+  int waiting;
+  unsigned generation;
+} TrainingBarrier;
+
+typedef struct TrainingJob
+{
+  Perceptron *p;
+  const Dataset *d;
+  const TrainingOptions *options;
+  const PerceptronKernels *kernels;
+  int numThreads;
+  TrainingBarrier barrier;
+  PERCEPTRON_D_TYPE *updates; // per thread: numInputs weight sums, then the bias sum
+  size_t updateStride;
+  PERCEPTRON_D_TYPE *rows; // per thread: DATASET_BLOCK gathered rows
+  int stop;
+  int epochs;
+  PERCEPTRON_D_TYPE loss;
+} TrainingJob;
+
+typedef struct TrainingWorker
+{
+  TrainingJob *job;
+  int id;
+  PERCEPTRON_D_TYPE loss;
+} TrainingWorker;
+
+static double wall_seconds(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static int hardware_threads(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+static void barrier_wait(TrainingBarrier *barrier)
+{
+  if (barrier->count <= 1)
+    return;
+  pthread_mutex_lock(&barrier->lock);
+  unsigned generation = barrier->generation;
+  if (++barrier->waiting == barrier->count)
+  {
+    barrier->waiting = 0;
+    barrier->generation++;
+    pthread_cond_broadcast(&barrier->wake);
+  }
+  else
+  {
+    while (generation == barrier->generation)
+      pthread_cond_wait(&barrier->wake, &barrier->lock);
+  }
+  pthread_mutex_unlock(&barrier->lock);
+}
+
+// Samples [begin, end): SGD steps on the shared weights; returns the loss
+static PERCEPTRON_D_TYPE train_hogwild(TrainingJob *job, int begin, int end, PERCEPTRON_D_TYPE *rows)
+{
+  Perceptron *p = job->p;
+  const Dataset *d = job->d;
+  PERCEPTRON_D_TYPE loss = 0;
+  for (int i0 = begin; i0 < end; i0 += DATASET_BLOCK)
+  {
+    int count = end - i0 < DATASET_BLOCK ? end - i0 : DATASET_BLOCK;
+    size_t stride;
+    const PERCEPTRON_D_TYPE *block = dataset_block(d, i0, count, rows, &stride);
+    for (int b = 0; b < count; b++)
+    {
+      PERCEPTRON_D_TYPE error = job->kernels->step(p->weights, &p->bias, block + (size_t)b * stride, d->numInputs,
+                                                   d->y[i0 + b], p->learningRate);
+      loss += error * error;
+    }
+  }
+  return loss;
+}
+
+// Samples [begin, end) against fixed weights, their updates summed into
+// updates; returns the loss
+static PERCEPTRON_D_TYPE train_batch_share(TrainingJob *job, int begin, int end, PERCEPTRON_D_TYPE *rows,
+                                           PERCEPTRON_D_TYPE *updates)
+{
+  const Perceptron *p = job->p;
+  const Dataset *d = job->d;
+  int n = d->numInputs;
+  for (int j = 0; j <= n; j++)
+    updates[j] = 0;
+
+  PERCEPTRON_D_TYPE loss = 0;
+  for (int i0 = begin; i0 < end; i0 += DATASET_BLOCK)
+  {
+    int count = end - i0 < DATASET_BLOCK ? end - i0 : DATASET_BLOCK;
+    size_t stride;
+    const PERCEPTRON_D_TYPE *block = dataset_block(d, i0, count, rows, &stride);
+    for (int b = 0; b < count; b++)
+    {
+      const PERCEPTRON_D_TYPE *x = block + (size_t)b * stride;
+      PERCEPTRON_D_TYPE error = d->y[i0 + b] - activate(job->kernels->dot(p->weights, p->bias, x, n));
+      if (error != 0)
+      {
+        for (int j = 0; j < n; j++)
+          updates[j] += error * x[j];
+        updates[n] += error;
+      }
+      loss += error * error;
+    }
+  }
+  return loss;
+}
+
+static void *training_worker(void *arg)
+{
+  TrainingWorker *worker = (TrainingWorker *)arg;
+  TrainingJob *job = worker->job;
+
+  // fit_parallel holds the lock until it knows how many threads started
+  pthread_mutex_lock(&job->barrier.lock);
+  pthread_mutex_unlock(&job->barrier.lock);
+
+  Perceptron *p = job->p;
+  int numSamples = job->d->numSamples, n = job->d->numInputs;
+  int t = worker->id, numThreads = job->numThreads;
+  PERCEPTRON_D_TYPE *rows = job->rows ? job->rows + (size_t)t * DATASET_BLOCK * n : NULL;
+  PERCEPTRON_D_TYPE *updates = job->updates + (size_t)t * job->updateStride;
+
+  for (int epoch = 0; epoch < job->options->numEpochs; epoch++)
+  {
+    PERCEPTRON_D_TYPE loss = 0;
+    if (job->options->mode == TRAIN_MINIBATCH)
+    {
+      int batchSize = job->options->batchSize;
+      for (int batch = 0; batch < numSamples; batch += batchSize)
+      {
+        int count = numSamples - batch < batchSize ? numSamples - batch : batchSize;
+        loss += train_batch_share(job, batch + (int)((long long)count * t / numThreads),
+                                  batch + (int)((long long)count * (t + 1) / numThreads), rows, updates);
+        barrier_wait(&job->barrier);
+
+        // Weights [first, last) of the update, index n being the bias
+        int first = (int)((long long)(n + 1) * t / numThreads);
+        int last = (int)((long long)(n + 1) * (t + 1) / numThreads);
+        for (int u = 0; u < numThreads; u++)
+        {
+          const PERCEPTRON_D_TYPE *other = job->updates + (size_t)u * job->updateStride;
+          for (int j = first; j < last; j++)
+          {
+            if (j < n)
+              p->weights[j] += p->learningRate * other[j];
+            else
+              p->bias += p->learningRate * other[j];
+          }
+        }
+        barrier_wait(&job->barrier);
+      }
+    }
+    else
+    {
+      loss = train_hogwild(job, (int)((long long)numSamples * t / numThreads),
+                           (int)((long long)numSamples * (t + 1) / numThreads), rows);
+    }
+    worker->loss = loss;
+    barrier_wait(&job->barrier);
+
+    // Thread 0 totals the epoch; everyone reads stop after the next barrier
+    if (t == 0)
+    {
+      job->loss = 0;
+      for (int u = 0; u < numThreads; u++)
+        job->loss += (worker - t + u)->loss;
+      job->epochs = epoch + 1;
+      job->stop = job->loss == 0;
+      if (job->options->verbose)
+        printf("Epoch %04d | Loss: %8.4f\n", epoch + 1, job->loss);
+    }
+    barrier_wait(&job->barrier);
+    if (job->stop)
+      break;
+  }
+  return NULL;
+}
+
+// Train p on d as options say; report may be NULL. Returns 0 on success.
+int fit_parallel(Perceptron *p, const Dataset *d, const TrainingOptions *options, TrainingReport *report)
+{
+  if (!p || !d || !options)
+  {
+    fprintf(stderr, "Invalid Perceptron, dataset or options\n");
+    return -1;
+  }
+
+  if (d->numInputs != p->numWeights)
+  {
+    fprintf(stderr, "Invalid inputs or input size mismatch\n");
+    return -1;
+  }
+
+  if (options->mode == TRAIN_MINIBATCH && options->batchSize <= 0)
+  {
+    fprintf(stderr, "Invalid batch size\n");
+    return -1;
+  }
+
+  TrainingJob job;
+  job.p = p;
+  job.d = d;
+  job.options = options;
+  job.kernels = perceptron_kernels();
+  job.numThreads = options->mode == TRAIN_SEQUENTIAL ? 1 : options->numThreads;
+  if (job.numThreads <= 0)
+    job.numThreads = hardware_threads();
+  if (job.numThreads > TRAINING_MAX_THREADS)
+    job.numThreads = TRAINING_MAX_THREADS;
+  if (job.numThreads > d->numSamples)
+    job.numThreads = d->numSamples > 0 ? d->numSamples : 1;
+  job.stop = 0;
+  job.epochs = 0;
+  job.loss = 0;
+
+  // Update buffers a whole number of cache lines apart, so threads summing
+  // into their own never share a line
+  job.updateStride = dataset_padded((size_t)d->numInputs + 1);
+  job.updates = aligned_malloc((size_t)job.numThreads * job.updateStride * sizeof(PERCEPTRON_D_TYPE));
+  job.rows = d->layout == DATASET_COLUMN_MAJOR
+                 ? aligned_malloc((size_t)job.numThreads * DATASET_BLOCK * d->numInputs * sizeof(PERCEPTRON_D_TYPE))
+                 : NULL;
+  if (!job.updates || (d->layout == DATASET_COLUMN_MAJOR && !job.rows))
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    aligned_free(job.updates);
+    aligned_free(job.rows);
+    return -1;
+  }
+
+  TrainingWorker workers[TRAINING_MAX_THREADS];
+  pthread_t threads[TRAINING_MAX_THREADS];
+  for (int t = 0; t < job.numThreads; t++)
+  {
+    workers[t].job = &job;
+    workers[t].id = t;
+    workers[t].loss = 0;
+  }
+
+  // A thread that fails to start means training with fewer; workers hold
+  // off until the final count is set
+  int started = 1;
+  pthread_mutex_init(&job.barrier.lock, NULL);
+  pthread_cond_init(&job.barrier.wake, NULL);
+  job.barrier.waiting = 0;
+  job.barrier.generation = 0;
+  job.barrier.count = job.numThreads;
+  pthread_mutex_lock(&job.barrier.lock);
+  for (int t = 1; t < job.numThreads; t++, started++)
+    if (pthread_create(&threads[t], NULL, training_worker, &workers[t]) != 0)
+      break;
+  job.numThreads = started;
+  job.barrier.count = started;
+  pthread_mutex_unlock(&job.barrier.lock);
+
+  double start = wall_seconds();
+  training_worker(&workers[0]);
+  for (int t = 1; t < started; t++)
+    pthread_join(threads[t], NULL);
+  double seconds = wall_seconds() - start;
+
+  pthread_cond_destroy(&job.barrier.wake);
+  pthread_mutex_destroy(&job.barrier.lock);
+  aligned_free(job.updates);
+  aligned_free(job.rows);
+
+  if (report)
+  {
+    report->epochs = job.epochs;
+    report->seconds = seconds;
+    report->loss = job.loss;
+  }
+  return 0;
+}
+
+// Binary datasets
+// Features and labels that are all 0 or 1, one bit each. Sample i takes
+// numWords = ceil(numInputs / 64) words at bits + i * numWords (input j at
+// bit j % 64 of word j / 64), and its label is bit i % 64 of labels[i / 64].
+// A dataset with a generator stores nothing: the generator fills blocks of
+// samples from their index when they are needed, so the sample count is
+// limited by time rather than memory.
+#define BIT_BLOCK 4096 // samples per generated block: 2^12, as generate_AND assumes
+
+// Fill count samples starting at first (a multiple of 64): features as
+// above, labels from bit 0 of labels[0]
+typedef void (*BitGenerator)(const void *ctx, long long first, int count, int numInputs,
+                             uint64_t *features, uint64_t *labels);
+
+typedef struct BitDataset
+{
+  long long numSamples;
+  int numInputs;
+  int numWords;
+  uint64_t *bits;   // NULL when generated
+  uint64_t *labels; // NULL when generated
+  BitGenerator generate;
+  const void *ctx;
+} BitDataset;
+
+// Zero-filled stored dataset
+BitDataset *new_BitDataset(long long numSamples, int numInputs)
+{
+  if (numSamples < 0 || numInputs <= 0)
+  {
+    fprintf(stderr, "Invalid dataset size\n");
+    return NULL;
+  }
+
+  BitDataset *d = malloc(sizeof(*d));
+  if (!d)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+
+  d->numSamples = numSamples;
+  d->numInputs = numInputs;
+  d->numWords = (numInputs + 63) / 64;
+  d->bits = aligned_malloc((size_t)numSamples * d->numWords * sizeof(uint64_t));
+  d->labels = aligned_malloc((size_t)(numSamples + 63) / 64 * sizeof(uint64_t));
+  d->generate = NULL;
+  d->ctx = NULL;
+  if (!d->bits || !d->labels)
+  {
+    fprintf(stderr, "Memory allocation for dataset failed\n");
+    aligned_free(d->bits);
+    aligned_free(d->labels);
+    free(d);
+    return NULL;
+  }
+  memset(d->bits, 0, (size_t)numSamples * d->numWords * sizeof(uint64_t));
+  memset(d->labels, 0, (size_t)(numSamples + 63) / 64 * sizeof(uint64_t));
+  return d;
+}
+
+// Dataset of numSamples samples made by generate on demand
+BitDataset *new_generated_BitDataset(long long numSamples, int numInputs, BitGenerator generate, const void *ctx)
+{
+  if (numSamples < 0 || numInputs <= 0 || !generate)
+  {
+    fprintf(stderr, "Invalid dataset size or generator\n");
+    return NULL;
+  }
+
+  BitDataset *d = malloc(sizeof(*d));
+  if (!d)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+
+  d->numSamples = numSamples;
+  d->numInputs = numInputs;
+  d->numWords = (numInputs + 63) / 64;
+  d->bits = NULL;
+  d->labels = NULL;
+  d->generate = generate;
+  d->ctx = ctx;
+  return d;
+}
+
+void delete_BitDataset(BitDataset *d)
+{
+  if (d)
+  {
+    aligned_free(d->bits);
+    aligned_free(d->labels);
+    free(d);
+  }
+}
+
+// Packed copy of d; any nonzero feature or label counts as 1
+BitDataset *bit_dataset_from(const Dataset *d)
+{
+  if (!d)
+  {
+    fprintf(stderr, "Invalid dataset\n");
+    return NULL;
+  }
+
+  BitDataset *packed = new_BitDataset(d->numSamples, d->numInputs);
+  if (!packed)
+    return NULL;
+
+  for (int i = 0; i < d->numSamples; i++)
+  {
+    uint64_t *features = packed->bits + (size_t)i * packed->numWords;
+    for (int j = 0; j < d->numInputs; j++)
+      if (*dataset_at(d, i, j) != 0)
+        features[j / 64] |= 1ull << (j % 64);
+    if (d->y[i] != 0)
+      packed->labels[i / 64] |= 1ull << (i % 64);
+  }
+  return packed;
+}
+
+// create_dataset's samples for up to 64 inputs: the bits of the sample
+// index, most significant first, labelled with their AND
+static void generate_AND(const void *ctx, long long first, int count, int numInputs,
+                         uint64_t *features, uint64_t *labels)
+{
+  (void)ctx;
+  uint64_t all = numInputs == 64 ? ~0ull : (1ull << numInputs) - 1;
+  // Reversing each index bit by bit costs too much per sample. first is a
+  // multiple of BIT_BLOCK (2^12) and b < BIT_BLOCK, so the two reverse
+  // separately: first's once, b's from two 6-bit halves
+  uint64_t base = 0;
+  for (int j = 0; j < numInputs; j++)
+    base |= ((uint64_t)first >> j & 1) << (numInputs - 1 - j);
+  uint64_t half[64];
+  for (int v = 0; v < 64; v++)
+  {
+    half[v] = 0;
+    for (int j = 0; j < 6; j++)
+      half[v] |= (uint64_t)(v >> j & 1) << (5 - j);
+  }
+  for (int b = 0; b < count; b++)
+  {
+    uint64_t low = half[b & 63] << 6 | half[b >> 6 & 63]; // b reversed in 12 bits
+    features[b] = base | (numInputs >= 12 ? low << (numInputs - 12) : low >> (12 - numInputs));
+  }
+  // Labels from the features
+  for (int w = 0; w < (count + 63) / 64; w++)
+  {
+    uint64_t word = 0;
+    for (int b = 64 * w; b < count && b < 64 * w + 64; b++)
+      word |= (uint64_t)(features[b] == all) << (b % 64);
+    labels[w] = word;
+  }
 }
 
-PERCEPTRON_D_TYPE predict(Perceptron *p,
-                          PERCEPTRON_D_TYPE *inputs, int numInputs)
+// Every 0/1 vector of numInputs <= 62 inputs, generated, labelled with AND
+BitDataset *new_AND_BitDataset(int numInputs)
 {
-  if (!p)
+  if (numInputs <= 0 || numInputs > 62)
   {
-    fprintf(stderr, "Invalid Perceptron\n");
-    return -1; // Indicate an error
+    fprintf(stderr, "Invalid number of inputs\n");
+    return NULL;
   }
+  return new_generated_BitDataset(1ll << numInputs, numInputs, generate_AND, NULL);
+}
 
-  if (!inputs || numInputs != p->numWeights)
+// Samples [first, first + count): stored ones in place, generated ones
+// into features/labels (BIT_BLOCK samples)
+static const uint64_t *bit_dataset_block(const BitDataset *d, long long first, int count,
+                                         uint64_t *features, uint64_t *labels, const uint64_t **blockLabels)
+{
+  if (d->bits)
+  {
+    *blockLabels = d->labels + first / 64;
+    return d->bits + (size_t)first * d->numWords;
+  }
+  d->generate(d->ctx, first, count, d->numInputs, features, labels);
+  *blockLabels = labels;
+  return features;
+}
+
+// Scratch for one generated block, NULL (and nothing to free) when stored
+static int bit_dataset_scratch(const BitDataset *d, uint64_t **features, uint64_t **labels)
+{
+  *features = NULL;
+  *labels = NULL;
+  if (d->bits)
+    return 0;
+  *features = aligned_malloc((size_t)BIT_BLOCK * d->numWords * sizeof(uint64_t));
+  *labels = aligned_malloc(BIT_BLOCK / 64 * sizeof(uint64_t));
+  if (!*features || !*labels)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    aligned_free(*features);
+    aligned_free(*labels);
+    return -1;
+  }
+  return 0;
+}
+
+// Returns the number of epochs run
+int fit_bits(Perceptron *p, const BitDataset *d, int numEpochs)
+{
+  if (!p || !d)
+  {
+    fprintf(stderr, "Invalid Perceptron or dataset\n");
+    return -1;
+  }
+
+  if (d->numInputs != p->numWeights)
   {
     fprintf(stderr, "Invalid inputs or input size mismatch\n");
-    return -1; // Indicate an error
+    return -1;
   }
 
-  PERCEPTRON_D_TYPE sum = p->bias;
-  for (int i = 0; i < p->numWeights; i++)
-    sum += p->weights[i] * inputs[i];
+  uint64_t *features, *labels;
+  if (bit_dataset_scratch(d, &features, &labels) != 0)
+    return -1;
 
-  return activate(sum);
+  const PerceptronKernels *kernels = perceptron_kernels();
+  int epoch = 0;
+  while (epoch < numEpochs)
+  {
+    // Errors are +-1, so the loss is a count; float would stop counting at 2^24
+    long long lossPerEpoch = 0;
+    for (long long first = 0; first < d->numSamples; first += BIT_BLOCK)
+    {
+      int count = d->numSamples - first < BIT_BLOCK ? (int)(d->numSamples - first) : BIT_BLOCK;
+      const uint64_t *blockLabels;
+      const uint64_t *block = bit_dataset_block(d, first, count, features, labels, &blockLabels);
+      for (int b = 0; b < count; b++)
+      {
+        PERCEPTRON_D_TYPE label = (PERCEPTRON_D_TYPE)(blockLabels[b / 64] >> (b % 64) & 1);
+        PERCEPTRON_D_TYPE error = kernels->bitStep(p->weights, &p->bias, block + (size_t)b * d->numWords,
+                                                   d->numWords, label, p->learningRate);
+        lossPerEpoch += error != 0;
+      }
+    }
+    printf("Epoch %04d | Loss: %8.4f\n", ++epoch, (double)lossPerEpoch);
+
+    if (lossPerEpoch == 0)
+    {
+      printf("Training complete at epoch %04d\n", epoch);
+      break;
+    }
+  }
+  aligned_free(features);
+  aligned_free(labels);
+  return epoch;
 }
 
-void update(Perceptron *p,
-            PERCEPTRON_D_TYPE *inputs, int numInputs,
-            PERCEPTRON_D_TYPE error)
+// The weights do not change while evaluating, so when the inputs are few
+// enough each byte of a sample is looked up in a table of the 256 partial
+// sums of its eight weights: 30 inputs cost four loads and adds, whatever
+// the bits
+#define BIT_TABLE_MAX_INPUTS 256
+
+PERCEPTRON_D_TYPE evaluate_bits(Perceptron *p, const BitDataset *d)
 {
-  if (!p)
+  if (!p || !d)
   {
-    fprintf(stderr, "Invalid Perceptron\n");
-    return;
+    fprintf(stderr, "Invalid Perceptron or dataset\n");
+    return -1;
   }
 
-  if (!inputs || numInputs != p->numWeights)
+  if (d->numInputs != p->numWeights)
   {
     fprintf(stderr, "Invalid inputs or input size mismatch\n");
-    return;
+    return -1;
   }
 
-  PERCEPTRON_D_TYPE delta = p->learningRate * error;
-  p->bias += delta;
-  for (int i = 0; i < p->numWeights; i++)
-    p->weights[i] += delta * inputs[i];
+  uint64_t *features, *labels;
+  if (bit_dataset_scratch(d, &features, &labels) != 0)
+    return -1;
+
+  int numBytes = (d->numInputs + 7) / 8;
+  PERCEPTRON_D_TYPE *sums = aligned_malloc(BIT_BLOCK * sizeof(PERCEPTRON_D_TYPE));
+  PERCEPTRON_D_TYPE *table = NULL;
+  if (d->numInputs <= BIT_TABLE_MAX_INPUTS)
+    table = aligned_malloc((size_t)(numBytes < 4 ? 4 : numBytes) * 256 * sizeof(PERCEPTRON_D_TYPE));
+  if (!sums || (d->numInputs <= BIT_TABLE_MAX_INPUTS && !table))
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    aligned_free(sums);
+    aligned_free(table);
+    aligned_free(features);
+    aligned_free(labels);
+    return -1;
+  }
+  if (table)
+  {
+    for (int k = 0; k < (numBytes < 4 ? 4 : numBytes); k++)
+    {
+      PERCEPTRON_D_TYPE *partial = table + 256 * k;
+      partial[0] = 0;
+      for (int v = 1; v < 256; v++)
+      {
+        // v without its lowest set bit was filled in already
+        int j = 8 * k + count_trailing_zeros((uint64_t)v);
+        partial[v] = partial[v & (v - 1)] + (j < d->numInputs ? p->weights[j] : 0);
+      }
+    }
+  }
+
+  const PerceptronKernels *kernels = perceptron_kernels();
+  PERCEPTRON_D_TYPE bias = p->bias;
+  int numWords = d->numWords;
+  long long correct = 0;
+  for (long long first = 0; first < d->numSamples; first += BIT_BLOCK)
+  {
+    int count = d->numSamples - first < BIT_BLOCK ? (int)(d->numSamples - first) : BIT_BLOCK;
+    const uint64_t *blockLabels;
+    const uint64_t *block = bit_dataset_block(d, first, count, features, labels, &blockLabels);
+    if (table && numBytes <= 4)
+    {
+      // Up to 32 inputs: always four lookups, the unused ones adding 0,
+      // since a fixed count unrolls and a variable one does not
+      for (int b = 0; b < count; b++)
+      {
+        uint64_t x = block[(size_t)b * numWords];
+        sums[b] = (bias + table[x & 0xFF] + table[512 + (x >> 16 & 0xFF)]) +
+                  (table[256 + (x >> 8 & 0xFF)] + table[768 + (x >> 24 & 0xFF)]);
+      }
+    }
+    else if (table)
+    {
+      for (int b = 0; b < count; b++)
+      {
+        // Two chains of adds, so consecutive lookups overlap
+        const uint64_t *x = block + (size_t)b * numWords;
+        PERCEPTRON_D_TYPE even = bias, odd = 0;
+        int k = 0;
+        for (; k + 1 < numBytes; k += 2)
+        {
+          even += table[256 * k + (x[k / 8] >> (8 * (k % 8)) & 0xFF)];
+          odd += table[256 * (k + 1) + (x[k / 8] >> (8 * (k % 8) + 8) & 0xFF)];
+        }
+        if (k < numBytes)
+          even += table[256 * k + (x[k / 8] >> (8 * (k % 8)) & 0xFF)];
+        sums[b] = even + odd;
+      }
+    }
+    else
+    {
+      for (int b = 0; b < count; b++)
+        sums[b] = kernels->bitDot(p->weights, bias, block + (size_t)b * numWords, numWords);
+    }
+
+    // Predictions packed like the labels, compared 64 at a time
+    for (int w = 0; w < (count + 63) / 64; w++)
+    {
+      int width = count - 64 * w < 64 ? count - 64 * w : 64;
+      uint64_t predicted = 0;
+      for (int b = 0; b < width; b++)
+        predicted |= (uint64_t)(activate(sums[64 * w + b]) != 0) << b;
+      uint64_t valid = width == 64 ? ~0ull : (1ull << width) - 1;
+      correct += popcount64(~(predicted ^ blockLabels[w]) & valid);
+    }
+  }
+  aligned_free(sums);
+  aligned_free(table);
+  aligned_free(features);
+  aligned_free(labels);
+  return d->numSamples ? (PERCEPTRON_D_TYPE)((double)correct / d->numSamples) : 0;
 }
 
-void fit(Perceptron *p,
-         PERCEPTRON_D_TYPE **X, PERCEPTRON_D_TYPE *y,
-         int numSamples, int numInputs, int numEpochs)
+// Sample files
+// Datasets larger than memory are streamed from disk: a 64-byte header,
+// then each sample as its numInputs features followed by its label, all
+// PERCEPTRON_D_TYPE. An epoch reads the file front to back in chunks of
+// whole samples, either into two buffers, a background thread filling one
+// while training consumes the other, or straight from a mapping of the
+// file, the kernel reading ahead and dropping the pages behind. Either way
+// an epoch costs one sequential read of the file, so it runs at disk speed.
+#define SAMPLE_FILE_MAGIC "LAB3SMP"
+#define SAMPLE_FILE_VERSION 1
+#define STREAM_CHUNK_BYTES (8 << 20) // default chunk size
+
+typedef struct SampleFileHeader
 {
-  if (!p)
+  char magic[8];        // SAMPLE_FILE_MAGIC
+  uint32_t version;     // SAMPLE_FILE_VERSION
+  uint32_t numInputs;   // features per sample
+  uint64_t numSamples;  // samples in the file
+  uint32_t elementSize; // sizeof(PERCEPTRON_D_TYPE) of the writer
+  uint32_t reserved;
+  uint64_t dataOffset; // byte offset of the first sample, 64-byte aligned
+  uint8_t padding[24];
+} SampleFileHeader;
+
+_Static_assert(sizeof(SampleFileHeader) == 64, "SampleFileHeader must be 64 bytes");
+
+#ifdef _WIN32
+#define file_seek _fseeki64
+#define file_tell _ftelli64
+#else
+#define file_seek fseeko
+#define file_tell ftello
+#endif
+
+// Writes d as a sample file; returns 0 on success
+int save_dataset(const Dataset *d, const char *path)
+{
+  if (!d || !path)
   {
-    fprintf(stderr, "Invalid Perceptron\n");
+    fprintf(stderr, "Invalid dataset or path\n");
+    return -1;
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (!file)
+  {
+    fprintf(stderr, "Cannot open '%s'\n", path);
+    return -1;
+  }
+
+  SampleFileHeader header = {0};
+  memcpy(header.magic, SAMPLE_FILE_MAGIC, sizeof(SAMPLE_FILE_MAGIC));
+  header.version = SAMPLE_FILE_VERSION;
+  header.numInputs = (uint32_t)d->numInputs;
+  header.numSamples = (uint64_t)d->numSamples;
+  header.elementSize = sizeof(PERCEPTRON_D_TYPE);
+  header.dataOffset = sizeof(header);
+
+  // A block of samples at a time, laid out as in the file
+  size_t recordSize = (size_t)d->numInputs + 1;
+  PERCEPTRON_D_TYPE *records = malloc((size_t)DATASET_BLOCK * recordSize * sizeof(PERCEPTRON_D_TYPE));
+  int ok = records && fwrite(&header, sizeof(header), 1, file) == 1;
+  for (int i0 = 0; ok && i0 < d->numSamples; i0 += DATASET_BLOCK)
+  {
+    int count = d->numSamples - i0 < DATASET_BLOCK ? d->numSamples - i0 : DATASET_BLOCK;
+    for (int b = 0; b < count; b++)
+    {
+      for (int j = 0; j < d->numInputs; j++)
+        records[b * recordSize + j] = *dataset_at(d, i0 + b, j);
+      records[b * recordSize + d->numInputs] = d->y[i0 + b];
+    }
+    ok = fwrite(records, recordSize * sizeof(PERCEPTRON_D_TYPE), count, file) == (size_t)count;
+  }
+  free(records);
+  if (fclose(file) != 0 || !ok)
+  {
+    fprintf(stderr, "Writing '%s' failed\n", path);
+    remove(path);
+    return -1;
+  }
+  return 0;
+}
+
+typedef struct SampleStream
+{
+  long long numSamples;
+  int numInputs;
+  size_t recordSize; // elements per sample: the features, then the label
+  int chunkSamples;
+  long long next; // chunk to hand out next
+  // Reading: the reader thread fills buffers[c % 2] with chunk c
+  FILE *file;
+  long long dataOffset;
+  PERCEPTRON_D_TYPE *buffers[2];
+  int filled[2]; // samples in each buffer, -1 while it is free
+  int held;      // buffer handed out last, -1 if none
+  int failed;
+  int stop;
+  int running;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  pthread_t reader;
+  // Mapping: the whole file, NULL when reading
+  unsigned char *map;
+  size_t mapLength;
+  size_t released; // bytes from the start of the map dropped this pass
+  const unsigned char *data;
+} SampleStream;
+
+static void *stream_reader(void *arg)
+{
+  SampleStream *s = (SampleStream *)arg;
+  for (long long c = 0; c * s->chunkSamples < s->numSamples; c++)
+  {
+    int buffer = (int)(c % 2);
+    pthread_mutex_lock(&s->lock);
+    while (s->filled[buffer] >= 0 && !s->stop)
+      pthread_cond_wait(&s->changed, &s->lock);
+    int stop = s->stop;
+    pthread_mutex_unlock(&s->lock);
+    if (stop)
+      break;
+
+    long long remaining = s->numSamples - c * s->chunkSamples;
+    int count = remaining < s->chunkSamples ? (int)remaining : s->chunkSamples;
+    int ok = fread(s->buffers[buffer], s->recordSize * sizeof(PERCEPTRON_D_TYPE), count, s->file) == (size_t)count;
+
+    pthread_mutex_lock(&s->lock);
+    if (ok)
+      s->filled[buffer] = count;
+    else
+      s->failed = 1;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+    if (!ok)
+      break;
+  }
+  return NULL;
+}
+
+// Stops the reader thread, if any, wherever it is in the file
+static void stream_end(SampleStream *s)
+{
+  if (s->running)
+  {
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+    s->running = 0;
+  }
+}
+
+// Starts a pass over the file from its first sample
+static int stream_begin(SampleStream *s)
+{
+  stream_end(s);
+  s->next = 0;
+  s->released = 0;
+  if (s->map)
+    return 0;
+
+  if (file_seek(s->file, s->dataOffset, SEEK_SET) != 0)
+  {
+    fprintf(stderr, "Seeking in sample file failed\n");
+    return -1;
+  }
+  s->filled[0] = s->filled[1] = -1;
+  s->held = -1;
+  s->failed = 0;
+  s->stop = 0;
+  if (pthread_create(&s->reader, NULL, stream_reader, s) != 0)
+  {
+    fprintf(stderr, "Failed to create reader thread\n");
+    return -1;
+  }
+  s->running = 1;
+  return 0;
+}
+
+// The next chunk of the pass, which stays valid until the following call.
+// Sets count to its samples, 0 at the end of the file and -1 on a read
+// error, when NULL is returned.
+static const PERCEPTRON_D_TYPE *stream_next(SampleStream *s, int *count)
+{
+  long long first = s->next * s->chunkSamples;
+  long long remaining = s->numSamples - first;
+  if (s->map)
+  {
+    size_t recordBytes = s->recordSize * sizeof(PERCEPTRON_D_TYPE);
+#ifndef _WIN32
+    // Pages wholly before this chunk (all of them at the end) are done with,
+    // and the chunk after it is read ahead while it is used
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t chunkBytes = (size_t)s->chunkSamples * recordBytes;
+    size_t offset = (size_t)(s->data - s->map) + (size_t)first * recordBytes;
+    size_t done = remaining <= 0 ? s->mapLength : offset / page * page;
+    if (done > s->released)
+    {
+      madvise(s->map + s->released, done - s->released, MADV_DONTNEED);
+      s->released = done;
+    }
+    if (remaining > s->chunkSamples)
+    {
+      size_t ahead = offset + chunkBytes;
+      size_t length = s->mapLength - ahead < chunkBytes ? s->mapLength - ahead : chunkBytes;
+      madvise(s->map + ahead / page * page, length + ahead % page, MADV_WILLNEED);
+    }
+#endif
+    if (remaining <= 0)
+    {
+      *count = 0;
+      return NULL;
+    }
+    *count = remaining < s->chunkSamples ? (int)remaining : s->chunkSamples;
+    s->next++;
+    return (const PERCEPTRON_D_TYPE *)(s->data + (size_t)first * recordBytes);
+  }
+
+  int buffer = (int)(s->next % 2);
+  pthread_mutex_lock(&s->lock);
+  if (s->held >= 0)
+  {
+    s->filled[s->held] = -1;
+    s->held = -1;
+    pthread_cond_broadcast(&s->changed);
+  }
+  while (remaining > 0 && s->filled[buffer] < 0 && !s->failed)
+    pthread_cond_wait(&s->changed, &s->lock);
+  *count = remaining <= 0 ? 0 : s->filled[buffer];
+  pthread_mutex_unlock(&s->lock);
+  if (*count < 0)
+  {
+    fprintf(stderr, "Reading sample file failed\n");
+    return NULL;
+  }
+  if (*count == 0)
+    return NULL;
+  s->held = buffer;
+  s->next++;
+  return s->buffers[buffer];
+}
+
+// Opens a sample file for streaming, chunkBytes at a time (0 for
+// STREAM_CHUNK_BYTES). With useMap the file is mapped rather than read;
+// on Windows it is always read.
+SampleStream *new_SampleStream(const char *path, size_t chunkBytes, int useMap)
+{
+  if (!path)
+  {
+    fprintf(stderr, "Invalid path\n");
+    return NULL;
+  }
+
+  FILE *file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "Cannot open '%s'\n", path);
+    return NULL;
+  }
+
+  // Chunks are far larger than a stdio buffer, so read straight into them
+  setvbuf(file, NULL, _IONBF, 0);
+  SampleFileHeader header;
+  long long fileSize = -1;
+  if (fread(&header, sizeof(header), 1, file) == 1 && file_seek(file, 0, SEEK_END) == 0)
+    fileSize = file_tell(file);
+  if (fileSize < 0 || memcmp(header.magic, SAMPLE_FILE_MAGIC, sizeof(SAMPLE_FILE_MAGIC)) != 0 ||
+      header.version != SAMPLE_FILE_VERSION)
+  {
+    fprintf(stderr, "'%s' is not a sample file\n", path);
+    fclose(file);
+    return NULL;
+  }
+  size_t recordBytes = ((size_t)header.numInputs + 1) * sizeof(PERCEPTRON_D_TYPE);
+  if (header.elementSize != sizeof(PERCEPTRON_D_TYPE) || header.numInputs == 0 || header.numInputs > INT32_MAX ||
+      header.dataOffset < sizeof(header) || header.dataOffset > (uint64_t)fileSize ||
+      header.numSamples > ((uint64_t)fileSize - header.dataOffset) / recordBytes)
+  {
+    fprintf(stderr, "Sample file '%s' is invalid or truncated\n", path);
+    fclose(file);
+    return NULL;
+  }
+
+  SampleStream *s = malloc(sizeof(*s));
+  if (!s)
+  {
+    fprintf(stderr, "Memory allocation failed\n");
+    fclose(file);
+    return NULL;
+  }
+  memset(s, 0, sizeof(*s));
+  s->numSamples = (long long)header.numSamples;
+  s->numInputs = (int)header.numInputs;
+  s->recordSize = header.numInputs + 1;
+  s->dataOffset = (long long)header.dataOffset;
+  size_t chunk = (chunkBytes ? chunkBytes : STREAM_CHUNK_BYTES) / recordBytes;
+  s->chunkSamples = chunk < 1 ? 1 : chunk > INT32_MAX ? INT32_MAX : (int)chunk;
+  s->held = -1;
+
+#ifndef _WIN32
+  if (useMap && fileSize > 0)
+  {
+    void *map = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (map != MAP_FAILED)
+    {
+      madvise(map, (size_t)fileSize, MADV_SEQUENTIAL);
+      s->map = map;
+      s->mapLength = (size_t)fileSize;
+      s->data = s->map + header.dataOffset;
+      fclose(file);
+      return s;
+    }
+    fprintf(stderr, "Mapping '%s' failed, reading it instead\n", path);
+  }
+#else
+  (void)useMap;
+#endif
+
+  size_t bytes = (size_t)s->chunkSamples * recordBytes;
+  s->buffers[0] = aligned_malloc(bytes);
+  s->buffers[1] = aligned_malloc(bytes);
+  if (!s->buffers[0] || !s->buffers[1] || pthread_mutex_init(&s->lock, NULL) != 0)
+  {
+    fprintf(stderr, "Memory allocation for stream buffers failed\n");
+    aligned_free(s->buffers[0]);
+    aligned_free(s->buffers[1]);
+    free(s);
+    fclose(file);
+    return NULL;
+  }
+  pthread_cond_init(&s->changed, NULL);
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  s->file = file;
+  return s;
+}
+
+void delete_SampleStream(SampleStream *s)
+{
+  if (!s)
     return;
+  if (s->map)
+  {
+#ifndef _WIN32
+    munmap(s->map, s->mapLength);
+#endif
+  }
+  else
+  {
+    stream_end(s);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->changed);
+    aligned_free(s->buffers[0]);
+    aligned_free(s->buffers[1]);
+    fclose(s->file);
   }
+  free(s);
+}
 
-  if (!X || !y || numInputs != p->numWeights)
+// Returns the number of epochs run
+int fit_stream(Perceptron *p, SampleStream *s, int numEpochs)
+{
+  if (!p || !s)
+  {
+    fprintf(stderr, "Invalid Perceptron or stream\n");
+    return -1;
+  }
+
+  if (s->numInputs != p->numWeights)
   {
     fprintf(stderr, "Invalid inputs or input size mismatch\n");
-    return;
+    return -1;
   }
 
-  for (int epoch = 0; epoch < numEpochs; epoch++)
+  const PerceptronKernels *kernels = perceptron_kernels();
+  int numInputs = s->numInputs;
+  int epoch = 0;
+  while (epoch < numEpochs)
   {
-    PERCEPTRON_D_TYPE lossPerEpoch = 0;
-    for (int i = 0; i < numSamples; i++)
-    {
-      PERCEPTRON_D_TYPE prediction = predict(p, X[i], numInputs);
-      PERCEPTRON_D_TYPE error = y[i] - prediction;
+    if (stream_begin(s) != 0)
+      return -1;
 
-      update(p, X[i], numInputs, error);
-      lossPerEpoch += error * error;
+    // Summed in double, which keeps counting past 2^24 samples
+    double lossPerEpoch = 0;
+    int count;
+    const PERCEPTRON_D_TYPE *chunk;
+    while ((chunk = stream_next(s, &count)))
+    {
+      for (int b = 0; b < count; b++)
+      {
+        const PERCEPTRON_D_TYPE *x = chunk + (size_t)b * s->recordSize;
+        PERCEPTRON_D_TYPE error = kernels->step(p->weights, &p->bias, x, numInputs, x[numInputs], p->learningRate);
+        lossPerEpoch += error * error;
+      }
     }
-    printf("Epoch %04d | Loss: %8.4f\n", epoch + 1, lossPerEpoch);
+    stream_end(s);
+    if (count < 0)
+      return -1;
+    printf("Epoch %04d | Loss: %8.4f\n", ++epoch, lossPerEpoch);
 
     if (lossPerEpoch == 0)
     {
-      printf("Training complete at epoch %04d\n", epoch + 1);
+      printf("Training complete at epoch %04d\n", epoch);
       break;
     }
   }
+  return epoch;
 }
 
-PERCEPTRON_D_TYPE evaluate(Perceptron *p,
-                           PERCEPTRON_D_TYPE **X, PERCEPTRON_D_TYPE *y,
-                           int numSamples, int numInputs)
+PERCEPTRON_D_TYPE evaluate_stream(Perceptron *p, SampleStream *s)
 {
-  if (!p)
+  if (!p || !s)
   {
-    fprintf(stderr, "Invalid Perceptron\n");
+    fprintf(stderr, "Invalid Perceptron or stream\n");
     return -1;
   }
 
-  if (!X || !y || numInputs != p->numWeights)
+  if (s->numInputs != p->numWeights)
   {
     fprintf(stderr, "Invalid inputs or input size mismatch\n");
     return -1;
   }
 
-  int correct = 0;
-  for (int i = 0; i < numSamples; i++)
+  if (stream_begin(s) != 0)
+    return -1;
+  const PerceptronKernels *kernels = perceptron_kernels();
+  long long correct = 0;
+  int count;
+  const PERCEPTRON_D_TYPE *chunk;
+  while ((chunk = stream_next(s, &count)))
   {
-    PERCEPTRON_D_TYPE prediction = predict(p, X[i], numInputs);
-    if (prediction == y[i])
-      correct++;
+    for (int b = 0; b < count; b++)
+    {
+      const PERCEPTRON_D_TYPE *x = chunk + (size_t)b * s->recordSize;
+      if (activate(kernels->dot(p->weights, p->bias, x, s->numInputs)) == x[s->numInputs])
+        correct++;
+    }
   }
-  return (PERCEPTRON_D_TYPE)correct / numSamples;
+  stream_end(s);
+  if (count < 0)
+    return -1;
+  return s->numSamples ? (PERCEPTRON_D_TYPE)((double)correct / s->numSamples) : 0;
 }
 
 int create_dataset(PERCEPTRON_D_TYPE ***X, PERCEPTRON_D_TYPE **y, int numInputs)
@@ -218,6 +1960,17 @@ int create_dataset(PERCEPTRON_D_TYPE ***X, PERCEPTRON_D_TYPE **y, int numInputs)
   return 0;
 }
 
+void free_dataset(PERCEPTRON_D_TYPE **X, PERCEPTRON_D_TYPE *y, int numSamples)
+{
+  if (X)
+  {
+    for (int i = 0; i < numSamples; i++)
+      free(X[i]);
+    free(X);
+  }
+  free(y);
+}
+
 void print_dataset(PERCEPTRON_D_TYPE **X, PERCEPTRON_D_TYPE *y, int numSamples, int numInputs)
 {
   printf("Dataset:\n");
@@ -236,12 +1989,10 @@ int main()
 
   int numInputs = 15;
   int numSamples = 1 << numInputs; // 2^numInputs
-  PERCEPTRON_D_TYPE **X;
-  PERCEPTRON_D_TYPE *y;
 
   printf("Creating dataset with %d samples and %d features...\n", numSamples, numInputs);
-  int res = create_dataset(&X, &y, numInputs);
-  if (!X || !y || res != 0)
+  Dataset *data = new_AND_Dataset(numInputs, DATASET_ROW_MAJOR);
+  if (!data)
   {
     fprintf(stderr, "Failed to create dataset\n");
     return 1;
@@ -249,39 +2000,127 @@ int main()
   else
   {
     printf("Dataset created successfully\n");
-    // print_dataset(X, y, numSamples, numInputs);
   }
 
   Perceptron *p = new_Perceptron(numInputs, 0.03);
   if (!p)
   {
     fprintf(stderr, "Failed to create Perceptron\n");
+    delete_Dataset(data);
     return 1;
   }
 
   // Test the initial Perceptron
   printf("==================================================\n");
   printf("Initial Perceptron predictions:\n");
-  PERCEPTRON_D_TYPE initialAccuracy = evaluate(p, (PERCEPTRON_D_TYPE **)X, y, numSamples, numInputs);
+  PERCEPTRON_D_TYPE initialAccuracy = evaluate_dataset(p, data);
   printf("Initial Accuracy: %.2f%%\n", initialAccuracy * 100);
 
   printf("==================================================\n");
-  fit(p, (PERCEPTRON_D_TYPE **)X, y, numSamples, numInputs, 1000);
+  clock_t start = clock();
+  int epochs = fit_dataset(p, data, 1000);
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  if (epochs > 0 && seconds > 0)
+    printf("%d epochs in %.3f s with %s kernels (%.1f M samples/s)\n", epochs, seconds,
+           perceptron_kernels()->name, (double)epochs * numSamples / seconds / 1e6);
 
   // Test the trained Perceptron
   printf("==================================================\n");
   printf("Trained Perceptron predictions:\n");
-  PERCEPTRON_D_TYPE finalAccuracy = evaluate(p, (PERCEPTRON_D_TYPE **)X, y, numSamples, numInputs);
+  PERCEPTRON_D_TYPE finalAccuracy = evaluate_dataset(p, data);
   printf("Final Accuracy: %.2f%%\n", finalAccuracy * 100);
 
+  // One starting point trained each way, against the sequential baseline
+  printf("==================================================\n");
+  printf("Training modes, %d threads:\n", hardware_threads());
+  const char *modeNames[] = {"sequential", "hogwild", "mini-batch"};
+  Perceptron *initial = new_Perceptron(numInputs, 0.03);
+  for (int mode = TRAIN_SEQUENTIAL; initial && mode <= TRAIN_MINIBATCH; mode++)
+  {
+    Perceptron *q = new_Perceptron(numInputs, 0.03);
+    if (!q)
+      break;
+    memcpy(q->weights, initial->weights, numInputs * sizeof(PERCEPTRON_D_TYPE));
+    q->bias = initial->bias;
+
+    TrainingOptions options = {(TrainingMode)mode, 0, 1024, 1000, 0};
+    TrainingReport report;
+    if (fit_parallel(q, data, &options, &report) == 0)
+      printf("%-10s: %4d epochs, %.3f s (%8.1f epochs/s), loss %8.4f, accuracy %.2f%%\n", modeNames[mode],
+             report.epochs, report.seconds, report.seconds > 0 ? report.epochs / report.seconds : 0.0,
+             report.loss, evaluate_dataset(q, data) * 100);
+    delete_Perceptron(q);
+  }
+  delete_Perceptron(initial);
+
+  // The same samples one bit each, and every 30-input sample generated
+  // from its index rather than stored
+  printf("==================================================\n");
+  BitDataset *packed = bit_dataset_from(data);
+  if (packed)
+  {
+    printf("Packed dataset: %zu bytes as floats, %zu as bits\n",
+           (data->stride * numSamples + numSamples) * sizeof(PERCEPTRON_D_TYPE),
+           (size_t)numSamples * packed->numWords * sizeof(uint64_t) + (numSamples + 63) / 64 * sizeof(uint64_t));
+    printf("Trained Perceptron on packed samples: %.2f%%\n", evaluate_bits(p, packed) * 100);
+  }
+  delete_BitDataset(packed);
+
+  const int wideInputs = 30;
+  BitDataset *wide = new_AND_BitDataset(wideInputs);
+  Perceptron *wideAnd = new_Perceptron(wideInputs, 0.03);
+  if (wide && wideAnd)
+  {
+    for (int i = 0; i < wideInputs; i++)
+      wideAnd->weights[i] = 1;
+    wideAnd->bias = -wideInputs + 0.5f;
+    double wideStart = wall_seconds();
+    PERCEPTRON_D_TYPE wideAccuracy = evaluate_bits(wideAnd, wide);
+    double wideSeconds = wall_seconds() - wideStart;
+    printf("%d-input AND over all %lld generated samples: %.2f%% in %.2f s (%.1f M samples/s)\n", wideInputs,
+           wide->numSamples, wideAccuracy * 100, wideSeconds, wide->numSamples / wideSeconds / 1e6);
+  }
+  delete_Perceptron(wideAnd);
+  delete_BitDataset(wide);
+
+  // The same samples streamed from a file, read in the background or mapped
+  printf("==================================================\n");
+  const char *samplePath = "lab-3-samples.bin";
+  if (save_dataset(data, samplePath) == 0)
+  {
+    const char *sourceNames[] = {"read", "mapped"};
+    for (int useMap = 0; useMap <= 1; useMap++)
+    {
+      SampleStream *stream = new_SampleStream(samplePath, 1 << 20, useMap);
+      Perceptron *q = new_Perceptron(numInputs, 0.03);
+      if (stream && q)
+      {
+        printf("Streaming %s (%s):\n", samplePath, sourceNames[useMap]);
+        double streamStart = wall_seconds();
+        int streamEpochs = fit_stream(q, stream, 5);
+        double streamSeconds = wall_seconds() - streamStart;
+        if (streamEpochs > 0 && streamSeconds > 0)
+          printf("%d epochs in %.3f s (%.1f MB/s)\n", streamEpochs, streamSeconds,
+                 streamEpochs * (double)numSamples * stream->recordSize * sizeof(PERCEPTRON_D_TYPE) /
+                     streamSeconds / 1e6);
+        printf("Stream-trained Perceptron: %.2f%% streamed, %.2f%% in memory\n", evaluate_stream(q, stream) * 100,
+               evaluate_dataset(q, data) * 100);
+      }
+      delete_Perceptron(q);
+      delete_SampleStream(stream);
+    }
+    remove(samplePath);
+  }
+
   // Test the trained Perceptron
   // printf("==================================================\n");
   // for (int i = 0; i < numSamples; i++)
   // {
-  //   PERCEPTRON_D_TYPE prediction = predict(p, X[i], numInputs);
-  //   printf("Input: [%d,%d] -> Output: %f\n", (int)X[i][0], (int)X[i][1], prediction);
+  //   PERCEPTRON_D_TYPE prediction = predict_sample(p, data, i);
+  //   printf("Input: [%d,%d] -> Output: %f\n", (int)data->X[i * data->stride], (int)data->X[i * data->stride + 1], prediction);
   // }
 
   delete_Perceptron(p);
+  delete_Dataset(data);
   return 0;
 }
\ No newline at end of file